@@ -7,30 +7,257 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <poll.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 
 #define DEVICE_PATH "/dev/shared_mem"
-#define BUFFER_SIZE (8 * 1024)
-#define MSG_SIZE (4 * 1024)
 
-/* IOCTL command */
+/* Buffer layout, must match shared_memory_demo.c */
+#define SHM_CACHELINE 64
+#define RING_HDR_SIZE 4096
+#define RING_SIZE (16 * 1024)
+#define BUFFER_SIZE (RING_HDR_SIZE + 2 * RING_SIZE)
+
+struct shm_ring_hdr {
+    uint32_t head;              /* written by the producer */
+    uint8_t pad0[SHM_CACHELINE - sizeof(uint32_t)];
+    uint32_t tail;              /* written by the consumer */
+    uint8_t pad1[SHM_CACHELINE - sizeof(uint32_t)];
+    uint32_t flags;             /* written by the kernel */
+    uint8_t pad2[SHM_CACHELINE - sizeof(uint32_t)];
+};
+
+#define SHM_RING_NEED_KICK 0x1
+
+#define SHM_REC_MSG 1
+#define SHM_REC_PAD 2
+#define SHM_REC_ALIGN 8
+#define SHM_MSG_MAX 1024
+
+struct shm_rec {
+    uint32_t len;
+    uint32_t type;
+    char data[];
+};
+
+/* IOCTL commands */
 #define SHARED_MEM_IOC_MAGIC 'S'
-#define SHARED_MEM_SEND_MSG _IO(SHARED_MEM_IOC_MAGIC, 1)
+#define SHARED_MEM_KICK _IO(SHARED_MEM_IOC_MAGIC, 1)
+#define SHARED_MEM_SET_EVENTFD _IOW(SHARED_MEM_IOC_MAGIC, 2, int)
+
+/* User view of one ring, head and tail are our private cursors */
+struct ring {
+    struct shm_ring_hdr *hdr;
+    char *data;
+    uint32_t head;
+    uint32_t tail;
+};
+
+static uint32_t rec_size(uint32_t len)
+{
+    return (sizeof(struct shm_rec) + len + SHM_REC_ALIGN - 1) & ~(SHM_REC_ALIGN - 1);
+}
+
+/* Queue one message on the user->kernel ring, returns -1 if it is full */
+static int ring_push(struct ring *ring, const char *msg, uint32_t len)
+{
+    uint32_t tail = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+    uint32_t off = ring->head & (RING_SIZE - 1);
+    uint32_t size = rec_size(len);
+    uint32_t pad = off + size > RING_SIZE ? RING_SIZE - off : 0;
+    struct shm_rec *rec;
+    
+    if (ring->head - tail + pad + size > RING_SIZE)
+        return -1;
+    
+    if (pad) {
+        rec = (struct shm_rec *)(ring->data + off);
+        rec->len = pad - sizeof(*rec);
+        rec->type = SHM_REC_PAD;
+        ring->head += pad;
+        off = 0;
+    }
+    
+    rec = (struct shm_rec *)(ring->data + off);
+    rec->len = len;
+    rec->type = SHM_REC_MSG;
+    memcpy(rec->data, msg, len);
+    ring->head += size;
+    __atomic_store_n(&ring->hdr->head, ring->head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Take the next message off the kernel->user ring into buf (NUL
+ * terminated, truncated to bufsize), returns its length or -1 if the
+ * ring is empty
+ */
+static int ring_pop(struct ring *ring, char *buf, size_t bufsize)
+{
+    uint32_t head = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+    struct shm_rec *rec;
+    uint32_t len, type;
+    
+    while (head != ring->tail) {
+        rec = (struct shm_rec *)(ring->data + (ring->tail & (RING_SIZE - 1)));
+        len = rec->len;
+        type = rec->type;
+        if (type == SHM_REC_MSG && buf)
+            snprintf(buf, bufsize, "%.*s", (int)len, rec->data);
+    
+        /* The record may be overwritten as soon as tail moves past it */
+        ring->tail += rec_size(len);
+        __atomic_store_n(&ring->hdr->tail, ring->tail, __ATOMIC_RELEASE);
+        if (type == SHM_REC_MSG)
+            return len;
+    }
+    return -1;
+}
+
+/*
+ * Kick the kernel if it went idle while requests are queued.  Called
+ * after producing requests and after consuming responses, which may have
+ * unblocked a kernel stalled on a full response ring.  Returns 1 if it
+ * kicked, -1 on error.
+ */
+static int kick_if_needed(int fd, struct ring *tx)
+{
+    /* Pairs with the barrier between setting the flag and rechecking */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!(__atomic_load_n(&tx->hdr->flags, __ATOMIC_RELAXED) & SHM_RING_NEED_KICK) ||
+        __atomic_load_n(&tx->hdr->tail, __ATOMIC_RELAXED) == tx->head)
+        return 0;
+    if (ioctl(fd, SHARED_MEM_KICK) < 0) {
+        perror("ioctl failed");
+        return -1;
+    }
+    return 1;
+}
+
+/* True if no response is queued, checked safely before going to sleep */
+static int ring_empty(struct ring *ring)
+{
+    /* Pairs with the barrier the kernel issues before checking our tail */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE) == ring->tail;
+}
+
+/* Send one message and print the response, waiting for it with poll() */
+static int send_message(int fd, struct ring *tx, struct ring *rx, const char *message)
+{
+    char response[SHM_MSG_MAX + 64];
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    
+    if (ring_push(tx, message, strnlen(message, SHM_MSG_MAX)) < 0) {
+        printf("Ring full\n");
+        return -1;
+    }
+    if (kick_if_needed(fd, tx) < 0)
+        return -1;
+    
+    if (poll(&pfd, 1, 1000) <= 0) {
+        printf("No response\n");
+        return -1;
+    }
+    
+    while (ring_pop(rx, response, sizeof(response)) >= 0)
+        printf("Response: %s\n", response);
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Stream count messages of size bytes: keep the request ring full, kick
+ * only when the kernel has gone idle, collect the echoes and sleep on an
+ * eventfd only when there is nothing to collect
+ */
+static int run_batch(int fd, struct ring *tx, struct ring *rx, long count, uint32_t size)
+{
+    char msg[SHM_MSG_MAX];
+    long sent = 0, received = 0, kicks = 0, waits = 0, popped;
+    uint64_t start, ns, val;
+    int efd, efd_none, ret, err = -1;
+    
+    if (size < 1 || size > SHM_MSG_MAX) {
+        printf("Message size must be 1-%d\n", SHM_MSG_MAX);
+        return -1;
+    }
+    memset(msg, 'm', size);
+    
+    efd = eventfd(0, 0);
+    if (efd < 0) {
+        perror("eventfd");
+        return -1;
+    }
+    if (ioctl(fd, SHARED_MEM_SET_EVENTFD, &efd) < 0) {
+        perror("ioctl failed");
+        goto out;
+    }
+    
+    start = now_ns();
+    while (received < count) {
+        while (sent < count && ring_push(tx, msg, size) == 0)
+            sent++;
+        ret = kick_if_needed(fd, tx);
+        if (ret < 0)
+            goto out;
+        kicks += ret;
+    
+        for (popped = 0; ring_pop(rx, NULL, 0) >= 0; popped++)
+            received++;
+        ret = kick_if_needed(fd, tx);
+        if (ret < 0)
+            goto out;
+        kicks += ret;
+    
+        /* Nothing to collect: the kernel signals when responses appear */
+        if (!popped && received < count && ring_empty(rx)) {
+            if (read(efd, &val, sizeof(val)) != sizeof(val)) {
+                perror("read eventfd");
+                goto out;
+            }
+            waits++;
+        }
+    }
+    ns = now_ns() - start;
+    
+    printf("%ld messages of %u bytes in %.3f ms: %.0f msgs/s\n",
+           received, size, ns / 1e6, received / (ns / 1e9));
+    printf("%ld kicks, %ld eventfd waits: %.4f syscalls per message\n",
+           kicks, waits, (double)(kicks + waits) / received);
+    err = 0;
+    
+out:
+    efd_none = -1;
+    ioctl(fd, SHARED_MEM_SET_EVENTFD, &efd_none);
+    close(efd);
+    return err;
+}
 
 int main(int argc, char *argv[])
 {
-    int fd;
+    int fd, ret = 0;
     void *buffer;
-    char *user_to_kernel;
-    char *kernel_to_user;
+    struct ring tx, rx;
     char message[512];
     
     if (argc < 2) {
         printf("Usage: %s <message>\n", argv[0]);
         printf("   or: %s -i  (interactive mode)\n", argv[0]);
+        printf("   or: %s -n <count> [size]  (batch mode)\n", argv[0]);
         return 1;
     }
     
@@ -49,9 +276,17 @@ int main(int argc, char *argv[])
         return 1;
     }
     
-    /* Setup pointers */
-    user_to_kernel = (char *)buffer;
-    kernel_to_user = (char *)buffer + MSG_SIZE;
+    /* Setup rings, picking up where the last user left them */
+    tx.hdr = buffer;
+    rx.hdr = tx.hdr + 1;
+    tx.data = (char *)buffer + RING_HDR_SIZE;
+    rx.data = tx.data + RING_SIZE;
+    tx.head = tx.hdr->head;
+    rx.tail = rx.hdr->tail;
+    
+    /* Drop responses nobody collected */
+    while (ring_pop(&rx, NULL, 0) >= 0)
+        ;
     
     if (strcmp(argv[1], "-i") == 0) {
         /* Interactive mode */
@@ -60,56 +295,32 @@ int main(int argc, char *argv[])
             printf("Enter message: ");
             if (!fgets(message, sizeof(message), stdin))
                 break;
-            
+    
             message[strcspn(message, "\n")] = '\0';
-            
+    
             if (strcmp(message, "quit") == 0)
                 break;
-            
-            /* Clear response area */
-            memset(kernel_to_user, 0, MSG_SIZE);
-            
-            /* Write message */
-            strncpy(user_to_kernel, message, MSG_SIZE - 1);
-            user_to_kernel[MSG_SIZE - 1] = '\0';
-            
-            /* Send to kernel */
-            if (ioctl(fd, SHARED_MEM_SEND_MSG) < 0) {
-                perror("ioctl failed");
+    
+            if (send_message(fd, &tx, &rx, message) < 0)
                 break;
-            }
-            
-            /* Read response */
-            printf("Response: %s\n\n", kernel_to_user);
+            printf("\n");
         }
+    } else if (strcmp(argv[1], "-n") == 0 && argc >= 3) {
+        /* Batch mode */
+        if (run_batch(fd, &tx, &rx, atol(argv[2]), argc >= 4 ? atoi(argv[3]) : 64) < 0)
+            ret = 1;
     } else {
         /* Single message mode */
         strncpy(message, argv[1], sizeof(message) - 1);
         message[sizeof(message) - 1] = '\0';
-        
+    
         printf("Sending: \"%s\"\n", message);
-        
-        /* Clear response area */
-        memset(kernel_to_user, 0, MSG_SIZE);
-        
-        /* Write message */
-        strncpy(user_to_kernel, message, MSG_SIZE - 1);
-        user_to_kernel[MSG_SIZE - 1] = '\0';
-        
-        /* Send to kernel */
-        if (ioctl(fd, SHARED_MEM_SEND_MSG) < 0) {
-            perror("ioctl failed");
-            munmap(buffer, BUFFER_SIZE);
-            close(fd);
-            return 1;
-        }
-        
-        /* Read response */
-        printf("Response: %s\n", kernel_to_user);
+        if (send_message(fd, &tx, &rx, message) < 0)
+            ret = 1;
     }
     
     /* Cleanup */
     munmap(buffer, BUFFER_SIZE);
     close(fd);
-    return 0;
+    return ret;
 }
\ No newline at end of file
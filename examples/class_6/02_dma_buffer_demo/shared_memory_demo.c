@@ -14,21 +14,90 @@
 #include <linux/uaccess.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/eventfd.h>
+#include <linux/poll.h>
 #include <asm/io.h>
 
 
 #define DEVICE_NAME "shared_mem"
-#define BUFFER_SIZE (8 * 1024)  /* 8KB total */
-#define MSG_SIZE (4 * 1024)     /* 4KB per area */
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Linux Kernel Programming Course");
 MODULE_DESCRIPTION("Simple shared memory demo");
 MODULE_VERSION("1.0");
 
+/*
+ * Shared buffer layout: one page of ring headers, then two rings of
+ * variable-length records, user->kernel and kernel->user.
+ *
+ * Each ring has a single producer and a single consumer.  head and tail
+ * are free-running byte counts; only the producer writes head and only
+ * the consumer writes tail, and each sits on its own cache line so the
+ * two sides do not bounce a line between them.  The producer fills a
+ * record and then publishes it with a release store of head; the
+ * consumer reads it and then frees the space with a release store of
+ * tail.  The other side pairs each store with an acquire load, so no
+ * lock is needed on either side.
+ *
+ * A record never wraps: when one does not fit before the end of the
+ * ring, the producer fills the rest with a pad record and starts over
+ * at offset 0.
+ *
+ * Notification is only needed at the edges.  The kernel drains the
+ * user->kernel ring from a work item; when it runs out of work it sets
+ * SHM_RING_NEED_KICK in that ring's flags, and user space only issues
+ * SHARED_MEM_KICK while the flag is set.  In the other direction the
+ * kernel signals the registered eventfd, and wakes poll(), when it adds
+ * responses to a ring the user had emptied.  Both checks rely on each
+ * side storing its index, issuing a full barrier and then loading the
+ * other side's, so at least one of them always sees the other.
+ */
+#define SHM_CACHELINE 64
+#define RING_HDR_SIZE 4096
+#define RING_SIZE (16 * 1024)   /* power of two */
+#define BUFFER_SIZE (RING_HDR_SIZE + 2 * RING_SIZE)
+
+struct shm_ring_hdr {
+    __u32 head;                 /* written by the producer */
+    __u8 pad0[SHM_CACHELINE - sizeof(__u32)];
+    __u32 tail;                 /* written by the consumer */
+    __u8 pad1[SHM_CACHELINE - sizeof(__u32)];
+    __u32 flags;                /* written by the kernel */
+    __u8 pad2[SHM_CACHELINE - sizeof(__u32)];
+};
+
+#define SHM_RING_NEED_KICK 0x1  /* consumer is idle, kick after producing */
+
+#define SHM_REC_MSG 1
+#define SHM_REC_PAD 2
+#define SHM_REC_ALIGN 8
+#define SHM_MSG_MAX 1024        /* payload limit of a user message */
+
+struct shm_rec {
+    __u32 len;                  /* payload bytes */
+    __u32 type;                 /* SHM_REC_MSG or SHM_REC_PAD */
+    char data[];
+};
+
 /* IOCTL commands */
 #define SHARED_MEM_IOC_MAGIC 'S'
-#define SHARED_MEM_SEND_MSG _IO(SHARED_MEM_IOC_MAGIC, 1)
+/* Wake the kernel consumer, only needed while SHM_RING_NEED_KICK is set */
+#define SHARED_MEM_KICK _IO(SHARED_MEM_IOC_MAGIC, 1)
+/* Eventfd to signal when responses arrive in an empty ring, -1 to clear */
+#define SHARED_MEM_SET_EVENTFD _IOW(SHARED_MEM_IOC_MAGIC, 2, int)
+
+/*
+ * Kernel view of one ring.  The kernel keeps its own copy of the index
+ * it owns and only ever publishes it, so whatever user space scribbles
+ * over the header cannot move the kernel's cursor.
+ */
+struct shm_ring {
+    struct shm_ring_hdr *hdr;
+    char *data;
+    u32 head;                   /* producer cursor, when the kernel produces */
+    u32 tail;                   /* consumer cursor, when the kernel consumes */
+};
 
 /* Device structure */
 struct shared_mem_device {
@@ -40,37 +109,213 @@ struct shared_mem_device {
     /* Shared buffer */
     void *shared_buffer;
     
-    /* Message areas */
-    char *user_to_kernel;   /* First 4KB */
-    char *kernel_to_user;   /* Second 4KB */
+    /* Message rings */
+    struct shm_ring user_to_kernel;
+    struct shm_ring kernel_to_user;
+    
+    /* Kernel consumer, the workqueue is ordered so it never runs twice */
+    struct workqueue_struct *wq;
+    struct work_struct work;
+    
+    /* Response notification */
+    wait_queue_head_t wait;
+    struct eventfd_ctx *eventfd;
+    struct file *eventfd_owner;
     
+    /* Protects eventfd and eventfd_owner */
     struct mutex mutex;
     unsigned long msg_count;
 };
 
 static struct shared_mem_device *demo_device;
 
-/* Process message from user */
-static void process_message(void)
+static inline u32 shm_rec_size(u32 len)
+{
+    return ALIGN(sizeof(struct shm_rec) + len, SHM_REC_ALIGN);
+}
+
+/*
+ * Next record the user has published, NULL if the ring is empty.
+ * Everything read from the header or a record header comes from user
+ * space, so the record header is read exactly once, checked, and handed
+ * back in *len and *type; callers must not look at it again.
+ */
+static struct shm_rec *ring_peek(struct shm_ring *ring, u32 *len, u32 *type)
+{
+    u32 head = smp_load_acquire(&ring->hdr->head);
+    u32 avail = head - ring->tail;
+    u32 off = ring->tail & (RING_SIZE - 1);
+    struct shm_rec *rec;
+    
+    if (!avail)
+        return NULL;
+    if (avail > RING_SIZE || avail < sizeof(*rec))
+        return ERR_PTR(-EIO);
+    
+    rec = (struct shm_rec *)(ring->data + off);
+    *len = READ_ONCE(rec->len);
+    *type = READ_ONCE(rec->type);
+    if (*len > RING_SIZE - sizeof(*rec) || shm_rec_size(*len) > avail ||
+        off + shm_rec_size(*len) > RING_SIZE)
+        return ERR_PTR(-EIO);
+    
+    return rec;
+}
+
+/* Give the space of a consumed record back to the producer */
+static void ring_consume(struct shm_ring *ring, u32 size)
+{
+    ring->tail += size;
+    smp_store_release(&ring->hdr->tail, ring->tail);
+}
+
+/*
+ * Room for a len byte payload at the producer cursor, NULL if the ring
+ * is full.  Nothing is visible to the consumer until ring_commit().
+ */
+static char *ring_reserve(struct shm_ring *ring, u32 len)
+{
+    u32 tail = smp_load_acquire(&ring->hdr->tail);
+    u32 used = ring->head - tail;
+    u32 off = ring->head & (RING_SIZE - 1);
+    u32 size = shm_rec_size(len);
+    u32 pad = off + size > RING_SIZE ? RING_SIZE - off : 0;
+    struct shm_rec *rec;
+    
+    /* A tail past the head can only be a corrupted header */
+    if (used > RING_SIZE || used + pad + size > RING_SIZE)
+        return NULL;
+    
+    if (pad) {
+        rec = (struct shm_rec *)(ring->data + off);
+        rec->len = pad - sizeof(*rec);
+        rec->type = SHM_REC_PAD;
+        ring->head += pad;
+        off = 0;
+    }
+    
+    rec = (struct shm_rec *)(ring->data + off);
+    rec->type = SHM_REC_MSG;
+    return rec->data;
+}
+
+/* Publish the reserved record, len may be less than was reserved */
+static void ring_commit(struct shm_ring *ring, u32 len)
 {
-    char *input = demo_device->user_to_kernel;
-    char *output = demo_device->kernel_to_user;
-    int len;
+    struct shm_rec *rec = (struct shm_rec *)(ring->data + (ring->head & (RING_SIZE - 1)));
     
-    mutex_lock(&demo_device->mutex);
+    rec->len = len;
+    ring->head += shm_rec_size(len);
+    smp_store_release(&ring->hdr->head, ring->head);
+}
+
+/*
+ * Answer every queued message with an echo.  Stops early, leaving the
+ * rest queued, when the response ring is full.  Returns the number of
+ * messages answered.  Only called from the work item.
+ */
+static long process_messages(void)
+{
+    struct shm_ring *in = &demo_device->user_to_kernel;
+    struct shm_ring *out = &demo_device->kernel_to_user;
+    u32 start = out->head;
+    struct shm_rec *rec;
+    long done = 0;
+    char *resp;
+    u32 len, type;
+    int n;
+    
+    while ((rec = ring_peek(in, &len, &type)) != NULL) {
+        if (IS_ERR(rec)) {
+            pr_warn_ratelimited("shared_mem: Corrupt user->kernel ring at %u\n", in->tail);
+            done = done ?: PTR_ERR(rec);
+            break;
+        }
+        
+        if (type != SHM_REC_MSG || len > SHM_MSG_MAX) {
+            /* Pad record, or a message too long to answer */
+            ring_consume(in, shm_rec_size(len));
+            continue;
+        }
+        
+        /* "Echo #<count>: " fits in 32 bytes */
+        resp = ring_reserve(out, len + 32);
+        if (!resp)
+            break;
+        
+        n = snprintf(resp, len + 32, "Echo #%lu: %.*s", ++demo_device->msg_count, len, rec->data);
+        pr_debug("shared_mem: Received message #%lu: \"%.*s\"\n",
+                 demo_device->msg_count, len, rec->data);
+        ring_commit(out, min_t(u32, n, len + 31));
+        ring_consume(in, shm_rec_size(len));
+        done++;
+    }
+    
+    if (done <= 0)
+        return done;
     
-    /* Get input length */
-    len = strnlen(input, MSG_SIZE - 1);
-    input[len] = '\0';
+    /*
+     * Each commit publishes head on its own, so the user may have taken
+     * some of this batch and gone to sleep on an empty ring before the
+     * rest landed.  Signal whenever its tail lies anywhere in this batch,
+     * [start, head).  A tail before start means it has not caught up with
+     * the previous batch yet and will find these responses itself.  Pairs
+     * with the barrier user space issues between storing tail and
+     * checking head before it goes to sleep.
+     */
+    smp_mb();
+    if (READ_ONCE(out->hdr->tail) - start < out->head - start) {
+        mutex_lock(&demo_device->mutex);
+        if (demo_device->eventfd)
+            eventfd_signal(demo_device->eventfd, 1);
+        mutex_unlock(&demo_device->mutex);
+    }
+    
+    /* Responses for EPOLLIN, freed space for EPOLLOUT */
+    if (wq_has_sleeper(&demo_device->wait))
+        wake_up_interruptible_poll(&demo_device->wait, EPOLLIN | EPOLLOUT);
+    return done;
+}
+
+/*
+ * Drain the user->kernel ring, then go idle with SHM_RING_NEED_KICK set.
+ * The ring is checked once more after setting the flag: a producer that
+ * published before that check is served here, one that published after
+ * it sees the flag and kicks.  The same goes for a consumer freeing room
+ * in a full response ring.
+ */
+static void shared_mem_work(struct work_struct *work)
+{
+    struct shm_ring_hdr *hdr = demo_device->user_to_kernel.hdr;
     
-    /* Log the message */
-    pr_info("shared_mem: Received message #%lu: \"%s\"\n", 
-            ++demo_device->msg_count, input);
+    do {
+        WRITE_ONCE(hdr->flags, 0);
+        process_messages();
+        WRITE_ONCE(hdr->flags, SHM_RING_NEED_KICK);
+        smp_mb();
+    } while (process_messages() > 0);
+}
+
+/* Replace the eventfd to signal, fd < 0 removes it */
+static int shared_mem_set_eventfd(struct file *filp, int fd)
+{
+    struct eventfd_ctx *ctx = NULL, *old;
     
-    /* Create echo response */
-    snprintf(output, MSG_SIZE, "Echo #%lu: %s", demo_device->msg_count, input);
+    if (fd >= 0) {
+        ctx = eventfd_ctx_fdget(fd);
+        if (IS_ERR(ctx))
+            return PTR_ERR(ctx);
+    }
     
+    mutex_lock(&demo_device->mutex);
+    old = demo_device->eventfd;
+    demo_device->eventfd = ctx;
+    demo_device->eventfd_owner = ctx ? filp : NULL;
     mutex_unlock(&demo_device->mutex);
+    
+    if (old)
+        eventfd_ctx_put(old);
+    return 0;
 }
 
 /* File operations */
@@ -83,24 +328,62 @@ static int shared_mem_open(struct inode *inode, struct file *filp)
 
 static int shared_mem_release(struct inode *inode, struct file *filp)
 {
+    struct eventfd_ctx *ctx = NULL;
+    
+    /* Drop the eventfd this file registered, if it is still current */
+    mutex_lock(&demo_device->mutex);
+    if (demo_device->eventfd_owner == filp) {
+        ctx = demo_device->eventfd;
+        demo_device->eventfd = NULL;
+        demo_device->eventfd_owner = NULL;
+    }
+    mutex_unlock(&demo_device->mutex);
+    if (ctx)
+        eventfd_ctx_put(ctx);
+    
     pr_debug("shared_mem: Device closed\n");
     return 0;
 }
 
 static long shared_mem_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
+    int fd;
+    
     if (_IOC_TYPE(cmd) != SHARED_MEM_IOC_MAGIC)
         return -ENOTTY;
     
     switch (cmd) {
-    case SHARED_MEM_SEND_MSG:
-        process_message();
-        break;
+    case SHARED_MEM_KICK:
+        queue_work(demo_device->wq, &demo_device->work);
+        return 0;
+    case SHARED_MEM_SET_EVENTFD:
+        if (get_user(fd, (int __user *)arg))
+            return -EFAULT;
+        return shared_mem_set_eventfd(filp, fd);
     default:
         return -ENOTTY;
     }
+}
+
+/*
+ * Readable while the response ring holds records, writable while the
+ * request ring has room for a maximum size message even after padding
+ * to its end.  The indices are only compared, so a user scribbling over
+ * the header can at worst confuse its own poll().
+ */
+static __poll_t shared_mem_poll(struct file *filp, poll_table *wait)
+{
+    struct shm_ring *in = &demo_device->user_to_kernel;
+    struct shm_ring *out = &demo_device->kernel_to_user;
+    __poll_t mask = 0;
     
-    return 0;
+    poll_wait(filp, &demo_device->wait, wait);
+    
+    if (READ_ONCE(out->hdr->tail) != READ_ONCE(out->head))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (READ_ONCE(in->hdr->head) - READ_ONCE(in->tail) + 2 * shm_rec_size(SHM_MSG_MAX) <= RING_SIZE)
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    return mask;
 }
 
 static int shared_mem_mmap(struct file *filp, struct vm_area_struct *vma)
@@ -133,6 +416,7 @@ static const struct file_operations shared_mem_fops = {
     .open = shared_mem_open,
     .release = shared_mem_release,
     .unlocked_ioctl = shared_mem_ioctl,
+    .poll = shared_mem_poll,
     .mmap = shared_mem_mmap,
 };
 
@@ -148,22 +432,35 @@ static int __init shared_memory_demo_init(void)
         return -ENOMEM;
     
     mutex_init(&demo_device->mutex);
+    init_waitqueue_head(&demo_device->wait);
+    INIT_WORK(&demo_device->work, shared_mem_work);
     
-    /* Allocate shared buffer */
+    /* Allocate shared buffer, zeroed so both rings start out empty */
     demo_device->shared_buffer = kzalloc(BUFFER_SIZE, GFP_KERNEL);
     if (!demo_device->shared_buffer) {
         ret = -ENOMEM;
         goto err_free_device;
     }
     
-    /* Setup message areas */
-    demo_device->user_to_kernel = (char *)demo_device->shared_buffer;
-    demo_device->kernel_to_user = (char *)demo_device->shared_buffer + MSG_SIZE;
+    /* Setup message rings */
+    demo_device->user_to_kernel.hdr = demo_device->shared_buffer;
+    demo_device->kernel_to_user.hdr = demo_device->user_to_kernel.hdr + 1;
+    demo_device->user_to_kernel.data = (char *)demo_device->shared_buffer + RING_HDR_SIZE;
+    demo_device->kernel_to_user.data = demo_device->user_to_kernel.data + RING_SIZE;
+    
+    /* The consumer starts out idle, the first message needs a kick */
+    demo_device->user_to_kernel.hdr->flags = SHM_RING_NEED_KICK;
+    
+    demo_device->wq = create_singlethread_workqueue("shared_mem");
+    if (!demo_device->wq) {
+        ret = -ENOMEM;
+        goto err_free_buffer;
+    }
     
     /* Get device number */
     ret = alloc_chrdev_region(&demo_device->devt, 0, 1, DEVICE_NAME);
     if (ret < 0)
-        goto err_free_buffer;
+        goto err_destroy_wq;
     
     /* Setup cdev */
     cdev_init(&demo_device->cdev, &shared_mem_fops);
@@ -189,8 +486,9 @@ static int __init shared_memory_demo_init(void)
     }
     
     pr_info("shared_mem: Device /dev/%s created\n", DEVICE_NAME);
-    pr_info("shared_mem: Buffer: %d bytes (user->kernel: 0-%d, kernel->user: %d-%d)\n",
-            BUFFER_SIZE, MSG_SIZE-1, MSG_SIZE, BUFFER_SIZE-1);
+    pr_info("shared_mem: Buffer: %d bytes (headers: 0-%d, user->kernel ring: %d-%d, kernel->user ring: %d-%d)\n",
+            BUFFER_SIZE, RING_HDR_SIZE - 1, RING_HDR_SIZE, RING_HDR_SIZE + RING_SIZE - 1,
+            RING_HDR_SIZE + RING_SIZE, BUFFER_SIZE - 1);
     
     return 0;
 
@@ -200,6 +498,8 @@ err_cdev_del:
     cdev_del(&demo_device->cdev);
 err_unregister_chrdev:
     unregister_chrdev_region(demo_device->devt, 1);
+err_destroy_wq:
+    destroy_workqueue(demo_device->wq);
 err_free_buffer:
     kfree(demo_device->shared_buffer);
 err_free_device:
@@ -215,6 +515,9 @@ static void __exit shared_memory_demo_exit(void)
     class_destroy(demo_device->class);
     cdev_del(&demo_device->cdev);
     unregister_chrdev_region(demo_device->devt, 1);
+    destroy_workqueue(demo_device->wq);
+    if (demo_device->eventfd)
+        eventfd_ctx_put(demo_device->eventfd);
     kfree(demo_device->shared_buffer);
     kfree(demo_device);
     
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <errno.h>
+
+// mdtest-style metadata benchmark for example_vfs
+//
+// Every thread creates, stats, reads, lists and unlinks its own set of
+// files; threads are spread over the directories round robin.  The
+// filesystem has no mkdir, so each directory is the root of its own
+// example_vfs mount, which also gives each one its own directory lock.
+//
+// Usage: bench_vfs [-t threads] [-d dirs] [-n files per thread]
+//                  [-s file size] [-o mount options]
+
+#define BENCH_ROOT "/mnt/example_vfs_bench"
+#define BENCH_MAX_DIRS 64
+#define BENCH_MAX_SIZE (1 << 20)
+
+enum {
+    PHASE_CREATE,
+    PHASE_STAT,
+    PHASE_READ,
+    PHASE_READDIR,
+    PHASE_UNLINK,
+    NR_PHASES,
+};
+
+static const char *phase_names[NR_PHASES] = {
+    "create", "stat", "read", "readdir", "unlink",
+};
+
+struct bench_config {
+    int threads;
+    int dirs;
+    int files;          // per thread
+    size_t size;        // bytes written by create, read back by read
+    const char *options;
+};
+
+struct bench_thread {
+    struct bench_config *cfg;
+    int id;
+    char *buf;
+    uint64_t *lat[NR_PHASES];   // per-op latency in ns
+    long nr[NR_PHASES];         // ops recorded
+    long entries;               // names seen by readdir
+    int errors;
+};
+
+static pthread_barrier_t phase_start, phase_end;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void file_path(char *path, size_t len, struct bench_config *cfg, int thread, int file)
+{
+    snprintf(path, len, "%s/d%d/t%d.f%d", BENCH_ROOT, thread % cfg->dirs, thread, file);
+}
+
+static int op_create(struct bench_thread *t, const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    
+    if (fd < 0)
+        return -1;
+    if (t->cfg->size && write(fd, t->buf, t->cfg->size) != (ssize_t)t->cfg->size) {
+        close(fd);
+        return -1;
+    }
+    return close(fd);
+}
+
+static int op_stat(struct bench_thread *t, const char *path)
+{
+    struct stat st;
+    
+    (void)t;
+    return stat(path, &st);
+}
+
+static int op_read(struct bench_thread *t, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    ssize_t n;
+    
+    if (fd < 0)
+        return -1;
+    n = read(fd, t->buf, t->cfg->size);
+    close(fd);
+    return n == (ssize_t)t->cfg->size ? 0 : -1;
+}
+
+static int op_unlink(struct bench_thread *t, const char *path)
+{
+    (void)t;
+    return unlink(path);
+}
+
+// One full scan of the thread's directory counts as one op
+static void run_readdir(struct bench_thread *t)
+{
+    char path[256];
+    struct dirent *de;
+    uint64_t start;
+    DIR *dir;
+    
+    snprintf(path, sizeof(path), "%s/d%d", BENCH_ROOT, t->id % t->cfg->dirs);
+    
+    start = now_ns();
+    dir = opendir(path);
+    if (!dir) {
+        t->errors++;
+        return;
+    }
+    while ((de = readdir(dir)) != NULL)
+        t->entries++;
+    closedir(dir);
+    t->lat[PHASE_READDIR][t->nr[PHASE_READDIR]++] = now_ns() - start;
+}
+
+static void *bench_thread_fn(void *arg)
+{
+    static int (*const ops[NR_PHASES])(struct bench_thread *, const char *) = {
+        [PHASE_CREATE] = op_create,
+        [PHASE_STAT]   = op_stat,
+        [PHASE_READ]   = op_read,
+        [PHASE_UNLINK] = op_unlink,
+    };
+    struct bench_thread *t = arg;
+    char path[256];
+    uint64_t start;
+    int phase, i;
+    
+    for (phase = 0; phase < NR_PHASES; phase++) {
+        pthread_barrier_wait(&phase_start);
+    
+        if (phase == PHASE_READDIR) {
+            run_readdir(t);
+        } else {
+            for (i = 0; i < t->cfg->files; i++) {
+                file_path(path, sizeof(path), t->cfg, t->id, i);
+                start = now_ns();
+                if (ops[phase](t, path) < 0)
+                    t->errors++;
+                t->lat[phase][t->nr[phase]++] = now_ns() - start;
+            }
+        }
+    
+        pthread_barrier_wait(&phase_end);
+    }
+    
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(uint64_t *sorted, long n, double p)
+{
+    long idx = (long)(p / 100.0 * (n - 1) + 0.5);
+    
+    return sorted[idx] / 1000.0;
+}
+
+static void report(const char *name, struct bench_thread *threads, int nr_threads,
+                   int phase, uint64_t wall_ns, double bytes_per_op)
+{
+    uint64_t *all;
+    long n = 0, i;
+    int t;
+    double secs = wall_ns / 1e9;
+    
+    for (t = 0; t < nr_threads; t++)
+        n += threads[t].nr[phase];
+    if (!n)
+        return;
+    
+    all = malloc(n * sizeof(*all));
+    if (!all)
+        return;
+    for (t = 0, i = 0; t < nr_threads; t++) {
+        memcpy(all + i, threads[t].lat[phase], threads[t].nr[phase] * sizeof(*all));
+        i += threads[t].nr[phase];
+    }
+    qsort(all, n, sizeof(*all), cmp_u64);
+    
+    printf("%-8s %10.0f %10.1f %10.1f %10.1f %10.1f %10.1f",
+           name, n / secs,
+           percentile_us(all, n, 50), percentile_us(all, n, 90),
+           percentile_us(all, n, 99), percentile_us(all, n, 99.9),
+           all[n - 1] / 1000.0);
+    if (bytes_per_op)
+        printf("  %8.1f MB/s", n * bytes_per_op / secs / (1 << 20));
+    printf("\n");
+    
+    free(all);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-t threads] [-d dirs] [-n files per thread] "
+            "[-s file size] [-o mount options]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_config cfg = {
+        .threads = 4,
+        .dirs = 1,
+        .files = 1000,
+        .size = 100,
+        .options = NULL,
+    };
+    struct bench_thread *threads = NULL;
+    pthread_t *tids = NULL;
+    uint64_t start, wall[NR_PHASES];
+    char path[256];
+    long entries = 0;
+    int opt, i, phase, mounted = 0, barriers = 0, errors = 0, ret = 1;
+    
+    while ((opt = getopt(argc, argv, "t:d:n:s:o:")) != -1) {
+        switch (opt) {
+        case 't': cfg.threads = atoi(optarg); break;
+        case 'd': cfg.dirs = atoi(optarg); break;
+        case 'n': cfg.files = atoi(optarg); break;
+        case 's': cfg.size = strtoul(optarg, NULL, 0); break;
+        case 'o': cfg.options = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (cfg.threads < 1 || cfg.dirs < 1 || cfg.dirs > BENCH_MAX_DIRS ||
+        cfg.files < 1 || cfg.size > BENCH_MAX_SIZE) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    printf("=== example_vfs metadata benchmark ===\n");
+    printf("threads %d, dirs %d, files/thread %d, file size %zu, options %s\n",
+           cfg.threads, cfg.dirs, cfg.files, cfg.size, cfg.options ? cfg.options : "(none)");
+    
+    mkdir("/mnt", 0755);
+    mkdir(BENCH_ROOT, 0755);
+    for (i = 0; i < cfg.dirs; i++) {
+        snprintf(path, sizeof(path), "%s/d%d", BENCH_ROOT, i);
+        if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+            perror("mkdir");
+            goto out;
+        }
+        if (mount("none", path, "example_vfs", 0, cfg.options) < 0) {
+            perror("mount");
+            printf("Make sure example_vfs module is loaded\n");
+            goto out;
+        }
+        mounted++;
+    }
+    
+    threads = calloc(cfg.threads, sizeof(*threads));
+    tids = calloc(cfg.threads, sizeof(*tids));
+    if (!threads || !tids) {
+        perror("calloc");
+        goto out;
+    }
+    
+    for (i = 0; i < cfg.threads; i++) {
+        threads[i].cfg = &cfg;
+        threads[i].id = i;
+        threads[i].buf = malloc(cfg.size ? cfg.size : 1);
+        if (!threads[i].buf) {
+            perror("malloc");
+            goto out;
+        }
+        memset(threads[i].buf, 'b', cfg.size);
+        for (phase = 0; phase < NR_PHASES; phase++) {
+            threads[i].lat[phase] = malloc(cfg.files * sizeof(uint64_t));
+            if (!threads[i].lat[phase]) {
+                perror("malloc");
+                goto out;
+            }
+        }
+    }
+    
+    // The main thread joins both barriers to time each phase from the
+    // moment every worker is released until the last one finishes
+    pthread_barrier_init(&phase_start, NULL, cfg.threads + 1);
+    pthread_barrier_init(&phase_end, NULL, cfg.threads + 1);
+    barriers = 1;
+    
+    for (i = 0; i < cfg.threads; i++)
+        pthread_create(&tids[i], NULL, bench_thread_fn, &threads[i]);
+    
+    for (phase = 0; phase < NR_PHASES; phase++) {
+        pthread_barrier_wait(&phase_start);
+        start = now_ns();
+        pthread_barrier_wait(&phase_end);
+        wall[phase] = now_ns() - start;
+    }
+    
+    for (i = 0; i < cfg.threads; i++) {
+        pthread_join(tids[i], NULL);
+        entries += threads[i].entries;
+        errors += threads[i].errors;
+    }
+    
+    printf("\n%-8s %10s %10s %10s %10s %10s %10s\n",
+           "phase", "ops/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    report(phase_names[PHASE_CREATE], threads, cfg.threads, PHASE_CREATE,
+           wall[PHASE_CREATE], cfg.size);
+    report(phase_names[PHASE_STAT], threads, cfg.threads, PHASE_STAT,
+           wall[PHASE_STAT], 0);
+    report(phase_names[PHASE_READ], threads, cfg.threads, PHASE_READ,
+           wall[PHASE_READ], cfg.size);
+    report(phase_names[PHASE_READDIR], threads, cfg.threads, PHASE_READDIR,
+           wall[PHASE_READDIR], 0);
+    report(phase_names[PHASE_UNLINK], threads, cfg.threads, PHASE_UNLINK,
+           wall[PHASE_UNLINK], 0);
+    
+    printf("\nreaddir: %ld entries in %.3f ms (%.0f entries/s)\n", entries,
+           wall[PHASE_READDIR] / 1e6, entries / (wall[PHASE_READDIR] / 1e9));
+    if (errors)
+        printf("%d operations FAILED\n", errors);
+    ret = errors ? 1 : 0;
+
+out:
+    for (i = 0; i < mounted; i++) {
+        snprintf(path, sizeof(path), "%s/d%d", BENCH_ROOT, i);
+        umount(path);
+    }
+    
+    if (barriers) {
+        pthread_barrier_destroy(&phase_start);
+        pthread_barrier_destroy(&phase_end);
+    }
+    // calloc() left whatever was not allocated NULL
+    for (i = 0; threads && i < cfg.threads; i++) {
+        free(threads[i].buf);
+        for (phase = 0; phase < NR_PHASES; phase++)
+            free(threads[i].lat[phase]);
+    }
+    free(threads);
+    free(tids);
+    
+    return ret;
+}
@@ -6,25 +6,160 @@
 #include <linux/mount.h>
 #include <linux/namei.h>
 #include <linux/statfs.h>
+#include <linux/fs_context.h>
+#include <linux/fs_parser.h>
+#include <linux/percpu_counter.h>
+#include <linux/seq_file.h>
+#include <linux/xattr.h>
+#include <linux/fsnotify.h>
+#include <linux/uaccess.h>
+#include <linux/highmem.h>
+#include <linux/splice.h>
+#include <linux/seqlock.h>
+#include <linux/falloc.h>
+#include <linux/xarray.h>
+#include <linux/stringhash.h>
+#include <linux/ctype.h>
+#include <linux/file.h>
+#include <linux/capability.h>
+#include <linux/mm.h>
+#include <linux/huge_mm.h>
+
+#define CREATE_TRACE_POINTS
+#include "simple_vfs_trace.h"
 
 #define SIMPLE_MAGIC 0x19980122
 
+// Bytes of name + NUL + value kept inside an xattr entry itself
+#define EXAMPLE_XATTR_INLINE 48
+
+// Regular files up to this size keep their data inside the inode
+#define EXAMPLE_INLINE_MAX 128
+
+// Default bound on cached negative dentries per mount (nr_negative=)
+#define EXAMPLE_NEG_DEFAULT 16384
+
+// huge= mount option
+enum {
+    EXAMPLE_HUGE_NEVER,     // order-0 pages only (default)
+    EXAMPLE_HUGE_ALWAYS,    // PMD folios for writes and every PMD-aligned mmap
+    EXAMPLE_HUGE_ADVISE,    // PMD folios only for MADV_HUGEPAGE mappings
+};
+
+// Inode numbers each CPU takes from its mount's allocator at a time
+#define EXAMPLE_INO_BATCH 1024
+
+// IOCTL command definitions (must match user space)
+#define EXAMPLE_VFS_IOC_MAGIC 'E'
+
+// Create many files in one directory with a single call
+struct example_bulk_create {
+    __u32 count;        // in: names in the buffer, out: files created
+    __u32 mode;         // permission bits for every new file
+    __u64 names;        // user pointer to @count packed NUL-terminated names
+    __u64 names_len;    // bytes at @names
+    __u64 inos;         // user pointer to __u64[count], filled with inode numbers
+};
+
+#define EXAMPLE_VFS_IOC_BULK_CREATE _IOWR(EXAMPLE_VFS_IOC_MAGIC, 1, struct example_bulk_create)
+
+// Dentry cache statistics for the mount the directory is on
+struct example_dcache_stats {
+    __u64 lookups;          // ->lookup calls, i.e. dcache misses
+    __u64 negative;         // negative dentries currently cached
+    __u64 negative_limit;   // nr_negative=, 0 means unlimited
+    __u64 negative_dropped; // lookup misses not cached because of the limit
+    __u64 negative_reused;  // cached negatives turned positive by a create
+};
+
+#define EXAMPLE_VFS_IOC_DCACHE_STATS _IOR(EXAMPLE_VFS_IOC_MAGIC, 2, struct example_dcache_stats)
+
+// Write the mount's files to @fd as a newc cpio archive
+struct example_export {
+    __s32 fd;           // in: file, pipe or socket open for writing
+    __u32 flags;        // in: must be 0
+    __u64 bytes;        // out: archive bytes written
+};
+
+#define EXAMPLE_VFS_IOC_EXPORT _IOWR(EXAMPLE_VFS_IOC_MAGIC, 3, struct example_export)
+
+#define EXAMPLE_BULK_MAX 4096
+
+static struct kmem_cache *example_inode_cachep;
+
+// Per-mount private data, hung off sb->s_fs_info
+struct example_sb_info {
+    unsigned long max_blocks;           // size= in pages, 0 means unlimited
+    unsigned long max_inodes;           // nr_inodes=, 0 means unlimited
+    struct percpu_counter used_blocks;
+    struct percpu_counter used_inodes;
+    
+    // Inode numbers, handed to each CPU in EXAMPLE_INO_BATCH runs
+    spinlock_t ino_lock;
+    ino_t next_ino;                     // start of the next unclaimed run
+    ino_t __percpu *ino_batch;          // next number in this CPU's run
+    
+    // Negative dentry cache
+    unsigned long max_negative;         // nr_negative=, 0 means unlimited
+    bool casefold;                      // ASCII case-insensitive names
+    struct percpu_counter nr_negative;
+    struct percpu_counter lookups;
+    atomic_long_t negative_dropped;
+    atomic_long_t negative_reused;
+    
+    char *import;                       // import= archive, only until fill_super
+    int huge;                           // huge=, EXAMPLE_HUGE_*
+};
+
+static inline struct example_sb_info *EXAMPLE_SB(struct super_block *sb)
+{
+    return sb->s_fs_info;
+}
+
 // Forward declarations
 static struct inode *example_alloc_inode(struct super_block *sb);
-static void example_destroy_inode(struct inode *inode);
+static void example_free_inode(struct inode *inode);
+static int example_drop_inode(struct inode *inode);
+static void example_evict_inode(struct inode *inode);
 static int example_statfs(struct dentry *dentry, struct kstatfs *buf);
+static int example_show_options(struct seq_file *m, struct dentry *root);
 
 // 1. Superblock Operations
 static const struct super_operations example_super_ops = {
     .alloc_inode    = example_alloc_inode,
-    .destroy_inode  = example_destroy_inode,
+    .free_inode     = example_free_inode,
+    .drop_inode     = example_drop_inode,
+    .evict_inode    = example_evict_inode,
     .statfs         = example_statfs,
+    .show_options   = example_show_options,
+};
+
+// One extended attribute; 64 bytes so a lookup touches a single cache line
+struct example_xattr {
+    u16 name_len;           // full name including prefix, without the NUL
+    u32 size;               // value length
+    char *ext;              // kmalloc'ed name + value when they don't fit inline
+    char inline_buf[EXAMPLE_XATTR_INLINE];
 };
 
 // Simple inode structure
 struct example_inode_info {
     struct inode vfs_inode;
-    char data[64];  // Simple data storage
+    long nr_blocks;     // pages charged to the sb, settled by example_sync_blocks()
+    atomic_long_t fault_blocks; // charged by mmap faults, which can't take the inode lock
+    spinlock_t size_lock;   // serializes size_seq writers
+    seqcount_spinlock_t size_seq;   // orders i_size updates after the data they expose
+    
+    // Small-file tier: data lives here, not in the page cache, while
+    // data_inline is set.  Both are only changed inside size_seq.
+    bool data_inline;
+    char idata[EXAMPLE_INLINE_MAX];
+    
+    // Extended attributes, sorted by full name
+    spinlock_t xattr_lock;
+    struct example_xattr *xattrs;
+    unsigned int xattr_count;
+    unsigned int xattr_cap;
 };
 
 // Forward declarations for inode operations
@@ -32,39 +167,82 @@ static struct dentry *example_lookup(struct inode *dir, struct dentry *dentry, u
 static int example_create(struct user_namespace *mnt_userns, struct inode *dir, 
                          struct dentry *dentry, umode_t mode, bool excl);
 static int example_unlink(struct inode *dir, struct dentry *dentry);
+static ssize_t example_listxattr(struct dentry *dentry, char *buffer, size_t size);
+static int example_setattr(struct user_namespace *mnt_userns, struct dentry *dentry,
+                           struct iattr *iattr);
+
+// Forward declarations for address space operations
+static int example_read_folio(struct file *file, struct folio *folio);
+static int example_write_begin(struct file *file, struct address_space *mapping,
+                               loff_t pos, unsigned len,
+                               struct page **pagep, void **fsdata);
+static int example_write_end(struct file *file, struct address_space *mapping,
+                             loff_t pos, unsigned len, unsigned copied,
+                             struct page *page, void *fsdata);
 
 // Forward declarations for file operations
-static ssize_t example_read(struct file *file, char __user *buf, size_t count, loff_t *ppos);
-static ssize_t example_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos);
+static ssize_t example_read_iter(struct kiocb *iocb, struct iov_iter *to);
+static ssize_t example_write_iter(struct kiocb *iocb, struct iov_iter *from);
+static ssize_t example_copy_file_range(struct file *file_in, loff_t pos_in,
+                                       struct file *file_out, loff_t pos_out,
+                                       size_t len, unsigned int flags);
+static long example_fallocate(struct file *file, int mode, loff_t offset, loff_t len);
+static loff_t example_llseek(struct file *file, loff_t offset, int whence);
 static int example_open(struct inode *inode, struct file *file);
-static int example_readdir(struct file *file, struct dir_context *ctx);
+static int example_mmap(struct file *file, struct vm_area_struct *vma);
+static unsigned long example_get_unmapped_area(struct file *file, unsigned long addr,
+                                               unsigned long len, unsigned long pgoff,
+                                               unsigned long flags);
+static long example_dir_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 
 // 2. Inode Operations
 static const struct inode_operations example_dir_inode_ops = {
     .lookup = example_lookup,
     .create = example_create,
     .unlink = example_unlink,
+    .listxattr = example_listxattr,
 };
 
 static const struct inode_operations example_file_inode_ops = {
-    // Simple file inode operations - can be empty for basic functionality
+    .setattr   = example_setattr,
+    .getattr   = simple_getattr,
+    .listxattr = example_listxattr,
+};
+
+// File data lives in the page cache, ramfs-style: folios are never
+// written back, so they are marked dirty without writeback accounting
+static const struct address_space_operations example_aops = {
+    .read_folio     = example_read_folio,
+    .write_begin    = example_write_begin,
+    .write_end      = example_write_end,
+    .dirty_folio    = noop_dirty_folio,
 };
 
 // 3. File Operations
 static const struct file_operations example_file_ops = {
-    .open    = example_open,
-    .read    = example_read,
-    .write   = example_write,
-    .llseek  = default_llseek,
+    .open            = example_open,
+    .read_iter       = example_read_iter,
+    .write_iter      = example_write_iter,
+    .splice_read     = generic_file_splice_read,
+    .splice_write    = iter_file_splice_write,
+    .copy_file_range = example_copy_file_range,
+    .fallocate       = example_fallocate,
+    .mmap            = example_mmap,
+    .get_unmapped_area = example_get_unmapped_area,
+    .fsync           = noop_fsync,
+    .llseek          = example_llseek,
 };
 
-// Directory file operations
+// Directory file operations.  Every file is a pinned positive child
+// dentry, so the dcache already holds the whole directory listing.
 static const struct file_operations example_dir_ops = {
     .open       = dcache_dir_open,
     .release    = dcache_dir_close,
     .llseek     = dcache_dir_lseek,
     .read       = generic_read_dir,
-    .iterate    = example_readdir,
+    .iterate_shared = dcache_readdir,
+    .unlocked_ioctl = example_dir_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
 };
 
 // Helper function to get example_inode_info from inode
@@ -73,30 +251,374 @@ static inline struct example_inode_info *EXAMPLE_I(struct inode *inode)
     return container_of(inode, struct example_inode_info, vfs_inode);
 }
 
+// File size
+//
+// Readers never take the inode lock: they read i_size and then copy the
+// pages below it.  Writers (serialized by the inode lock) publish a new
+// size only after the data is in the page, inside size_seq, so a reader
+// that sees the new size is guaranteed to see the data too.
+static void example_size_write(struct inode *inode, loff_t size)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    
+    spin_lock(&ei->size_lock);
+    write_seqcount_begin(&ei->size_seq);
+    i_size_write(inode, size);
+    write_seqcount_end(&ei->size_seq);
+    spin_unlock(&ei->size_lock);
+}
+
+static loff_t example_size_read(struct inode *inode)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    unsigned int seq;
+    loff_t size;
+    
+    do {
+        seq = read_seqcount_begin(&ei->size_seq);
+        size = i_size_read(inode);
+    } while (read_seqcount_retry(&ei->size_seq, seq));
+    
+    return size;
+}
+
+// Start time for a traced operation, only sampled while its event is on:
+//   u64 start = example_trace_start(trace_example_vfs_read_enabled());
+static __always_inline u64 example_trace_start(bool enabled)
+{
+    return enabled ? ktime_get_ns() : 0;
+}
+
+// Space and inode accounting
+//
+// Charges go through per-CPU counters so that the common case touches only
+// a local slot; percpu_counter_compare() falls back to an exact sum only
+// when the approximate value is within the per-CPU error of the limit.
+static int example_reserve(struct percpu_counter *used, unsigned long limit, long nr)
+{
+    percpu_counter_add(used, nr);
+    
+    if (limit && percpu_counter_compare(used, limit) > 0) {
+        percpu_counter_sub(used, nr);
+        return -ENOSPC;
+    }
+    
+    return 0;
+}
+
+static int example_reserve_blocks(struct super_block *sb, long nr)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(sb);
+    
+    return example_reserve(&sbi->used_blocks, sbi->max_blocks, nr);
+}
+
+static void example_release_blocks(struct super_block *sb, long nr)
+{
+    percpu_counter_sub(&EXAMPLE_SB(sb)->used_blocks, nr);
+}
+
+static int example_reserve_inode(struct super_block *sb)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(sb);
+    
+    return example_reserve(&sbi->used_inodes, sbi->max_inodes, 1);
+}
+
+static void example_release_inode(struct super_block *sb)
+{
+    percpu_counter_dec(&EXAMPLE_SB(sb)->used_inodes);
+}
+
+// Settle an inode's block charge to the pages it actually holds.
+//
+// New pages are charged up front in example_write_begin() and
+// example_vm_fault() so the limit is enforced before memory is used; pages
+// that appear or go away by other means (reads of holes, truncate, racing
+// faults) are picked up here.  Callers hold the inode lock.
+static void example_sync_blocks(struct inode *inode)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    long nr;
+    
+    // Fold fault charges in first so their pages are counted in nr
+    ei->nr_blocks += atomic_long_xchg(&ei->fault_blocks, 0);
+    nr = READ_ONCE(inode->i_mapping->nrpages);
+    if (nr != ei->nr_blocks) {
+        percpu_counter_add(&EXAMPLE_SB(inode->i_sb)->used_blocks, nr - ei->nr_blocks);
+        ei->nr_blocks = nr;
+    }
+    inode->i_blocks = (blkcnt_t)nr << (PAGE_SHIFT - 9);
+}
+
+// huge=: cache the PMD-aligned range of the file around @index as one
+// PMD-sized folio, charged up front like any other new page.  Returns the
+// locked, not yet uptodate folio, or NULL when order-0 pages have to do:
+// no THP in this kernel, no room under size=, part of the range is cached
+// already or the allocation failed.  The caller owns the charge.
+static struct folio *example_alloc_huge(struct inode *inode, pgoff_t index)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    struct address_space *mapping = inode->i_mapping;
+    gfp_t gfp = mapping_gfp_mask(mapping);
+    struct folio *folio;
+    
+    if (example_reserve_blocks(inode->i_sb, HPAGE_PMD_NR))
+        return NULL;
+    
+    folio = filemap_alloc_folio(gfp | __GFP_NORETRY | __GFP_NOWARN, HPAGE_PMD_ORDER);
+    if (folio) {
+        if (!filemap_add_folio(mapping, folio, round_down(index, HPAGE_PMD_NR), gfp))
+            return folio;
+        folio_put(folio);
+    }
+    example_release_blocks(inode->i_sb, HPAGE_PMD_NR);
+#endif
+    return NULL;
+}
+
+// Inline data
+//
+// Most files are a few bytes of config or a lock file, and giving each a
+// page of its own wastes 4K.  Files up to EXAMPLE_INLINE_MAX bytes keep
+// their data in the inode and charge no blocks; the first write, truncate
+// or fallocate that needs more, or the first mmap fault, moves it into
+// page 0 and the file stays in the page cache from then on.  Readers go
+// through size_seq without locks.  Writers hold the inode lock, but a
+// fault cannot take it (it already holds mmap_lock), so every inline
+// update and the move itself also happen under size_lock and re-check
+// data_inline there.
+
+// Snapshot an inline file into @buf.  Returns the size, or -1 once the
+// file lives in the page cache (which is final: it never moves back).
+static loff_t example_inline_read(struct inode *inode, char *buf)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    unsigned int seq;
+    loff_t size;
+    
+    do {
+        seq = read_seqcount_begin(&ei->size_seq);
+        if (!READ_ONCE(ei->data_inline))
+            return -1;
+        size = min_t(loff_t, i_size_read(inode), EXAMPLE_INLINE_MAX);
+        memcpy(buf, ei->idata, size);
+    } while (read_seqcount_retry(&ei->size_seq, seq));
+    
+    return size;
+}
+
+// Store @len bytes at @pos, which the caller has checked fit inline, and
+// make the size at least @pos + @len.  The bytes between the old size and
+// @pos are zeroed first.  Returns false if a fault moved the file to the
+// page cache since the caller looked; the caller then takes the page path.
+static bool example_inline_write(struct inode *inode, loff_t pos,
+                                 const char *buf, size_t len)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    loff_t size = inode->i_size;
+    
+    spin_lock(&ei->size_lock);
+    if (!ei->data_inline) {
+        spin_unlock(&ei->size_lock);
+        return false;
+    }
+    
+    write_seqcount_begin(&ei->size_seq);
+    if (pos > size)
+        memset(ei->idata + size, 0, pos - size);
+    memcpy(ei->idata + pos, buf, len);
+    if (pos + len > size)
+        i_size_write(inode, pos + len);
+    write_seqcount_end(&ei->size_seq);
+    spin_unlock(&ei->size_lock);
+    
+    return true;
+}
+
+// Set the size of an inline file to @size (at most EXAMPLE_INLINE_MAX),
+// zeroing any growth; same contract as example_inline_write()
+static bool example_inline_truncate(struct inode *inode, loff_t size)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    loff_t oldsize = inode->i_size;
+    
+    spin_lock(&ei->size_lock);
+    if (!ei->data_inline) {
+        spin_unlock(&ei->size_lock);
+        return false;
+    }
+    
+    write_seqcount_begin(&ei->size_seq);
+    if (size > oldsize)
+        memset(ei->idata + oldsize, 0, size - oldsize);
+    i_size_write(inode, size);
+    write_seqcount_end(&ei->size_seq);
+    spin_unlock(&ei->size_lock);
+    
+    return true;
+}
+
+// Copy the inline data into @folio, the locked, not yet uptodate folio at
+// index 0, and retire the inline copy.  The page is filled before data_inline is
+// cleared, so a lock-free reader always finds the data in one place or the
+// other.  Returns false if the file was no longer inline.
+static bool example_inline_fill_folio(struct inode *inode, struct folio *folio)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    
+    spin_lock(&ei->size_lock);
+    if (!ei->data_inline) {
+        spin_unlock(&ei->size_lock);
+        return false;
+    }
+    
+    folio_zero_range(folio, 0, folio_size(folio));
+    memcpy_to_page(folio_page(folio, 0), 0, ei->idata,
+                   min_t(loff_t, inode->i_size, EXAMPLE_INLINE_MAX));
+    
+    write_seqcount_begin(&ei->size_seq);
+    WRITE_ONCE(ei->data_inline, false);
+    write_seqcount_end(&ei->size_seq);
+    spin_unlock(&ei->size_lock);
+    
+    return true;
+}
+
+// Move an inline file into page 0 from the write side.  Callers hold the
+// inode lock.
+static int example_inline_to_page(struct inode *inode)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    struct address_space *mapping = inode->i_mapping;
+    struct page *page;
+    
+    if (!READ_ONCE(ei->data_inline))
+        return 0;
+    
+    // A fault may have instantiated page 0 already; if so it is uptodate
+    page = find_lock_page(mapping, 0);
+    if (!page) {
+        if (example_reserve_blocks(inode->i_sb, 1))
+            return -ENOSPC;
+        
+        page = find_or_create_page(mapping, 0, mapping_gfp_mask(mapping));
+        if (!page) {
+            example_release_blocks(inode->i_sb, 1);
+            return -ENOMEM;
+        }
+        ei->nr_blocks++;
+    }
+    
+    if (!PageUptodate(page)) {
+        if (!example_inline_fill_folio(inode, page_folio(page)))
+            zero_user(page, 0, PAGE_SIZE);
+        SetPageUptodate(page);
+        set_page_dirty(page);
+    }
+    unlock_page(page);
+    put_page(page);
+    
+    return 0;
+}
+
+// Inode numbers
+//
+// get_next_ino() is one counter shared by every mount of every pseudo
+// filesystem.  Each mount instead hands out its own numbers, in per-CPU
+// runs, so creating files touches a shared cache line once per
+// EXAMPLE_INO_BATCH inodes and independent mounts never touch each other's.
+static ino_t example_next_ino(struct super_block *sb)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(sb);
+    ino_t *next = get_cpu_ptr(sbi->ino_batch);
+    ino_t ino = *next;
+    
+    // Runs start on a multiple of the batch size, so this means "run used up"
+    if (unlikely(ino % EXAMPLE_INO_BATCH == 0)) {
+        spin_lock(&sbi->ino_lock);
+        ino = sbi->next_ino;
+        sbi->next_ino += EXAMPLE_INO_BATCH;
+        spin_unlock(&sbi->ino_lock);
+        
+        // 0 is not a valid inode number
+        if (unlikely(!ino))
+            ino++;
+    }
+    *next = ino + 1;
+    put_cpu_ptr(sbi->ino_batch);
+    
+    return ino;
+}
+
 // Superblock Operations Implementation
+
+// Slab constructor: runs once per object, not on every allocation
+static void example_inode_init_once(void *obj)
+{
+    struct example_inode_info *ei = obj;
+    
+    spin_lock_init(&ei->xattr_lock);
+    spin_lock_init(&ei->size_lock);
+    seqcount_spinlock_init(&ei->size_seq, &ei->size_lock);
+    inode_init_once(&ei->vfs_inode);
+}
+
 static struct inode *example_alloc_inode(struct super_block *sb)
 {
     struct example_inode_info *ei;
     
-    ei = kmalloc(sizeof(struct example_inode_info), GFP_KERNEL);
+    ei = kmem_cache_alloc(example_inode_cachep, GFP_KERNEL);
     if (!ei)
         return NULL;
     
-    memset(ei->data, 0, sizeof(ei->data));
+    ei->nr_blocks = 0;
+    atomic_long_set(&ei->fault_blocks, 0);
+    ei->data_inline = false;
     
-    // Initialize the VFS inode properly
-    inode_init_once(&ei->vfs_inode);
+    ei->xattrs = NULL;
+    ei->xattr_count = 0;
+    ei->xattr_cap = 0;
     
     return &ei->vfs_inode;
 }
 
-static void example_destroy_inode(struct inode *inode)
+static void example_xattr_free_all(struct example_inode_info *ei);
+
+// Positive dentries pin their inodes, so the final iput() only comes for
+// inodes that were unlinked or never linked (unused bulk preallocations).
+// Nothing can look those up again, so caching them would only hold memory.
+static int example_drop_inode(struct inode *inode)
+{
+    return generic_delete_inode(inode);
+}
+
+// Last reference to an inode that is going away: free its data and
+// give back everything it was charged for
+static void example_evict_inode(struct inode *inode)
+{
+    truncate_inode_pages_final(&inode->i_data);
+    clear_inode(inode);
+    
+    example_xattr_free_all(EXAMPLE_I(inode));
+    
+    // Every inode on this sb was charged by example_get_inode()
+    example_release_blocks(inode->i_sb, EXAMPLE_I(inode)->nr_blocks +
+                           atomic_long_read(&EXAMPLE_I(inode)->fault_blocks));
+    example_release_inode(inode->i_sb);
+}
+
+// Called after an RCU grace period, once path walk can no longer see the inode
+static void example_free_inode(struct inode *inode)
 {
-    kfree(EXAMPLE_I(inode));
+    kmem_cache_free(example_inode_cachep, EXAMPLE_I(inode));
 }
 
 static int example_statfs(struct dentry *dentry, struct kstatfs *buf)
 {
+    struct example_sb_info *sbi = EXAMPLE_SB(dentry->d_sb);
+    s64 used;
+    
     buf->f_type = SIMPLE_MAGIC;
     buf->f_bsize = PAGE_SIZE;
     buf->f_blocks = 0;
@@ -105,16 +627,145 @@ static int example_statfs(struct dentry *dentry, struct kstatfs *buf)
     buf->f_files = 0;
     buf->f_ffree = 0;
     buf->f_namelen = 255;
+    
+    if (sbi->max_blocks) {
+        used = percpu_counter_sum_positive(&sbi->used_blocks);
+        buf->f_blocks = sbi->max_blocks;
+        buf->f_bfree = buf->f_bavail = used < sbi->max_blocks ? sbi->max_blocks - used : 0;
+    }
+    
+    if (sbi->max_inodes) {
+        used = percpu_counter_sum_positive(&sbi->used_inodes);
+        buf->f_files = sbi->max_inodes;
+        buf->f_ffree = used < sbi->max_inodes ? sbi->max_inodes - used : 0;
+    }
+    
+    return 0;
+}
+
+static int example_show_options(struct seq_file *m, struct dentry *root)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(root->d_sb);
+    
+    if (sbi->max_blocks)
+        seq_printf(m, ",size=%luk", sbi->max_blocks << (PAGE_SHIFT - 10));
+    if (sbi->max_inodes)
+        seq_printf(m, ",nr_inodes=%lu", sbi->max_inodes);
+    if (sbi->max_negative != EXAMPLE_NEG_DEFAULT)
+        seq_printf(m, ",nr_negative=%lu", sbi->max_negative);
+    if (sbi->casefold)
+        seq_puts(m, ",casefold");
+    if (sbi->huge == EXAMPLE_HUGE_ALWAYS)
+        seq_puts(m, ",huge=always");
+    else if (sbi->huge == EXAMPLE_HUGE_ADVISE)
+        seq_puts(m, ",huge=advise");
+    return 0;
+}
+
+// Dentry cache
+//
+// Lookup misses leave negative dentries behind so that the next probe of
+// the same name (build tools walking include paths do little else) is
+// answered from the dcache.  Each cached negative holds one slot of
+// nr_negative=, recorded in d_fsdata; once the slots are gone further
+// misses are still answered but dropped on their final dput().  The slot
+// is given back when the dentry is freed or a create makes it positive.
+#define EXAMPLE_D_NEGATIVE ((void *)1)
+
+// Take a slot for @dentry about to become or stay negative
+static void example_d_cache_negative(struct dentry *dentry)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(dentry->d_sb);
+    
+    if (dentry->d_fsdata)
+        return;
+    
+    if (example_reserve(&sbi->nr_negative, sbi->max_negative, 1))
+        atomic_long_inc(&sbi->negative_dropped);
+    else
+        dentry->d_fsdata = EXAMPLE_D_NEGATIVE;
+}
+
+// d_instantiate() for a dentry that may hold a negative slot
+static void example_d_instantiate(struct dentry *dentry, struct inode *inode)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(dentry->d_sb);
+    
+    if (dentry->d_fsdata) {
+        dentry->d_fsdata = NULL;
+        percpu_counter_dec(&sbi->nr_negative);
+        atomic_long_inc(&sbi->negative_reused);
+    }
+    d_instantiate(dentry, inode);
+}
+
+// Final dput(): keep a negative only if it holds a slot
+static int example_d_delete(const struct dentry *dentry)
+{
+    return d_really_is_negative(dentry) && !dentry->d_fsdata;
+}
+
+static void example_d_release(struct dentry *dentry)
+{
+    if (dentry->d_fsdata)
+        percpu_counter_dec(&EXAMPLE_SB(dentry->d_sb)->nr_negative);
+}
+
+// casefold: ASCII-only folding, so hashing stays a byte loop with no
+// Unicode tables.  Both hooks may run under RCU and must not block.
+static int example_ci_d_hash(const struct dentry *dentry, struct qstr *q)
+{
+    unsigned long hash = init_name_hash(dentry);
+    unsigned int i;
+    
+    for (i = 0; i < q->len; i++)
+        hash = partial_name_hash(tolower(q->name[i]), hash);
+    q->hash = end_name_hash(hash);
     return 0;
 }
 
+static int example_ci_d_compare(const struct dentry *dentry, unsigned int len,
+                                const char *str, const struct qstr *name)
+{
+    return len != name->len || strncasecmp(str, name->name, len);
+}
+
+// A cached negative matches every spelling of its name; a create must not
+// reuse it or the new file would take the spelling of the earlier miss
+static int example_ci_d_revalidate(struct dentry *dentry, unsigned int flags)
+{
+    if (d_really_is_negative(dentry) && (flags & (LOOKUP_CREATE | LOOKUP_RENAME_TARGET)))
+        return 0;
+    return 1;
+}
+
+static const struct dentry_operations example_dentry_ops = {
+    .d_delete   = example_d_delete,
+    .d_release  = example_d_release,
+};
+
+static const struct dentry_operations example_ci_dentry_ops = {
+    .d_revalidate = example_ci_d_revalidate,
+    .d_hash     = example_ci_d_hash,
+    .d_compare  = example_ci_d_compare,
+    .d_delete   = example_d_delete,
+    .d_release  = example_d_release,
+};
+
 // Inode Operations Implementation
 static struct inode *example_get_inode(struct super_block *sb, umode_t mode)
 {
-    struct inode *inode = new_inode(sb);
+    struct inode *inode;
+    
+    if (example_reserve_inode(sb))
+        return NULL;
+    
+    inode = new_inode(sb);
+    if (!inode)
+        example_release_inode(sb);
     
     if (inode) {
-        inode->i_ino = get_next_ino();
+        inode->i_ino = example_next_ino(sb);
         inode->i_mode = mode;
         inode->i_uid = current_fsuid();
         inode->i_gid = current_fsgid();
@@ -127,6 +778,15 @@ static struct inode *example_get_inode(struct super_block *sb, umode_t mode)
         case S_IFREG:
             inode->i_op = &example_file_inode_ops;
             inode->i_fop = &example_file_ops;
+            inode->i_mapping->a_ops = &example_aops;
+            // Start out inline; the first write past EXAMPLE_INLINE_MAX moves the data
+            EXAMPLE_I(inode)->data_inline = true;
+            // The page cache is the only copy of the data: never reclaim it
+            mapping_set_gfp_mask(inode->i_mapping, GFP_HIGHUSER);
+            mapping_set_unevictable(inode->i_mapping);
+            // PMD folios from example_alloc_huge() are only allowed in here
+            if (EXAMPLE_SB(sb)->huge != EXAMPLE_HUGE_NEVER)
+                mapping_set_large_folios(inode->i_mapping);
             break;
         case S_IFDIR:
             inode->i_op = &example_dir_inode_ops;
@@ -140,172 +800,1719 @@ static struct inode *example_get_inode(struct super_block *sb, umode_t mode)
 
 static struct dentry *example_lookup(struct inode *dir, struct dentry *dentry, unsigned int flags)
 {
-    pr_info("example_vfs: lookup called for '%s'\n", dentry->d_name.name);
+    u64 start = example_trace_start(trace_example_vfs_lookup_enabled());
     
-    // For demonstration, we'll create a simple file on lookup
+    percpu_counter_inc(&EXAMPLE_SB(dir->i_sb)->lookups);
+    
+    // For demonstration, we'll create a simple file on lookup.  It is
+    // pinned like a created file so that example_unlink()'s dput() is
+    // balanced and the file (and its data) outlives memory pressure.
     if (strcmp(dentry->d_name.name, "testfile") == 0) {
         struct inode *inode = example_get_inode(dir->i_sb, S_IFREG | 0644);
         if (inode) {
             d_add(dentry, inode);
+            dget(dentry);
+            trace_example_vfs_lookup(dir, dentry, 0, start);
             return NULL;
         }
     }
     
-    // File not found
+    // File not found.  A create is about to fill the dentry in, so it is
+    // not worth a slot and must not count as a reused negative.
+    if (!(flags & LOOKUP_CREATE))
+        example_d_cache_negative(dentry);
     d_add(dentry, NULL);
+    trace_example_vfs_lookup(dir, dentry, 0, start);
     return NULL;
 }
 
 static int example_create(struct user_namespace *mnt_userns, struct inode *dir, 
                          struct dentry *dentry, umode_t mode, bool excl)
 {
+    u64 start = example_trace_start(trace_example_vfs_create_enabled());
     struct inode *inode;
     
-    pr_info("example_vfs: create called for '%s'\n", dentry->d_name.name);
-    
     inode = example_get_inode(dir->i_sb, mode | S_IFREG);
-    if (!inode)
+    if (!inode) {
+        trace_example_vfs_create(dir, dentry, -ENOSPC, start);
         return -ENOSPC;
+    }
     
-    d_instantiate(dentry, inode);
+    example_d_instantiate(dentry, inode);
     dget(dentry);
     dir->i_mtime = dir->i_ctime = current_time(dir);
     
+    trace_example_vfs_create(dir, dentry, 0, start);
     return 0;
 }
 
 static int example_unlink(struct inode *dir, struct dentry *dentry)
 {
+    u64 start = example_trace_start(trace_example_vfs_unlink_enabled());
     struct inode *inode = d_inode(dentry);
     
-    pr_info("example_vfs: unlink called for '%s'\n", dentry->d_name.name);
-    
     inode->i_ctime = dir->i_ctime = dir->i_mtime = current_time(inode);
     drop_nlink(inode);
+    
+    // The VFS turns the dentry negative once we return
+    example_d_cache_negative(dentry);
+    
+    // Trace before dropping the pin: the caller's reference keeps it alive
+    trace_example_vfs_unlink(dir, dentry, 0, start);
     dput(dentry);
     
     return 0;
 }
 
-// File Operations Implementation
-static int example_open(struct inode *inode, struct file *file)
+// Bulk creation
+//
+// Tools unpacking archives create thousands of files back to back.  Doing
+// it in one call lets us allocate every inode up front, outside the
+// directory lock, then take the lock and the permission check once for
+// the whole batch instead of once per file.
+static bool example_bulk_name_ok(const char *name, size_t len)
 {
-    pr_info("example_vfs: File opened\n");
-    return 0;
+    if (!len || len > NAME_MAX || memchr(name, '/', len))
+        return false;
+    if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.')))
+        return false;
+    return true;
 }
 
-static ssize_t example_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+// lookup_one_len() for a name about to be created, with the create intent
+// lookup_one_len() cannot pass: a miss goes to example_lookup() with
+// LOOKUP_CREATE, so it takes no negative slot and the create does not
+// count as a reused negative.  On casefold mounts a cached negative with
+// another spelling is dropped so the file gets the name it is created
+// with.  The caller holds the parent locked and has checked @name.
+static struct dentry *example_lookup_new(const char *name, struct dentry *parent, int len)
 {
-    struct inode *inode = file_inode(file);
-    struct example_inode_info *ei = EXAMPLE_I(inode);
-    size_t len = strlen(ei->data);
-    
-    pr_info("example_vfs: read called, pos=%lld, count=%zu\n", *ppos, count);
-    
-    if (*ppos >= len)
-        return 0;
+    struct qstr this = QSTR_INIT(name, len);
+    struct dentry *dentry;
+    int err;
     
-    if (*ppos + count > len)
-        count = len - *ppos;
+    this.hash = full_name_hash(parent, name, len);
+    if (parent->d_flags & DCACHE_OP_HASH) {
+        err = parent->d_op->d_hash(parent, &this);
+        if (err < 0)
+            return ERR_PTR(err);
+    }
     
-    if (copy_to_user(buf, ei->data + *ppos, count))
-        return -EFAULT;
+    dentry = d_lookup(parent, &this);
+    if (dentry) {
+        if (d_really_is_positive(dentry) || !memcmp(dentry->d_name.name, name, len))
+            return dentry;
+        d_invalidate(dentry);
+        dput(dentry);
+    }
     
-    *ppos += count;
-    return count;
+    dentry = d_alloc(parent, &this);
+    if (!dentry)
+        return ERR_PTR(-ENOMEM);
+    example_lookup(d_inode(parent), dentry, LOOKUP_CREATE);
+    return dentry;
 }
 
-static ssize_t example_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+static long example_bulk_create(struct file *file, struct example_bulk_create __user *uarg)
 {
-    struct inode *inode = file_inode(file);
-    struct example_inode_info *ei = EXAMPLE_I(inode);
-    
-    pr_info("example_vfs: write called, pos=%lld, count=%zu\n", *ppos, count);
+    struct dentry *parent = file->f_path.dentry;
+    struct inode *dir = d_inode(parent);
+    struct example_bulk_create req;
+    struct inode **inodes = NULL;
+    struct dentry *dentry;
+    unsigned int i, allocated, created = 0;
+    char *names, *name, *end;
+    u64 *inos = NULL;
+    umode_t mode;
+    long ret;
     
-    if (count > sizeof(ei->data) - 1)
-        count = sizeof(ei->data) - 1;
-    
-    if (copy_from_user(ei->data, buf, count))
+    if (copy_from_user(&req, uarg, sizeof(req)))
         return -EFAULT;
     
-    ei->data[count] = '\0';
-    inode->i_size = count;
-    
-    return count;
-}
-
-// Directory Operations Implementation
-static int example_readdir(struct file *file, struct dir_context *ctx)
-{
-    pr_info("example_vfs: readdir called, pos=%lld\n", ctx->pos);
+    if (!req.count || req.count > EXAMPLE_BULK_MAX || !req.names_len ||
+        req.names_len > (u64)req.count * (NAME_MAX + 1))
+        return -EINVAL;
     
-    if (ctx->pos == 0) {
-        if (!dir_emit_dot(file, ctx))
-            return 0;
-        ctx->pos = 1;
-    }
+    names = vmemdup_user(u64_to_user_ptr(req.names), req.names_len);
+    if (IS_ERR(names))
+        return PTR_ERR(names);
     
-    if (ctx->pos == 1) {
-        if (!dir_emit_dotdot(file, ctx))
-            return 0;
-        ctx->pos = 2;
-    }
+    ret = -EINVAL;
+    if (names[req.names_len - 1] != '\0')
+        goto out_free;
     
-    if (ctx->pos == 2) {
-        if (!dir_emit(ctx, "testfile", 8, 1000, DT_REG))
-            return 0;
-        ctx->pos = 3;
-    }
+    ret = -ENOMEM;
+    inos = kvcalloc(req.count, sizeof(*inos), GFP_KERNEL);
+    inodes = kvcalloc(req.count, sizeof(*inodes), GFP_KERNEL);
+    if (!inos || !inodes)
+        goto out_free;
     
-    return 0;
-}
-
-// Filesystem mount and unmount
-static int example_fill_super(struct super_block *sb, void *data, int silent)
-{
-    struct inode *root;
+    ret = mnt_want_write_file(file);
+    if (ret)
+        goto out_free;
     
-    pr_info("example_vfs: fill_super called\n");
+    // Allocate every inode before taking the directory lock
+    mode = (req.mode & S_IALLUGO & ~current_umask()) | S_IFREG;
+    for (allocated = 0; allocated < req.count; allocated++) {
+        inodes[allocated] = example_get_inode(dir->i_sb, mode);
+        if (!inodes[allocated])
+            break;
+    }
     
-    sb->s_blocksize = PAGE_SIZE;
-    sb->s_blocksize_bits = PAGE_SHIFT;
-    sb->s_magic = SIMPLE_MAGIC;
-    sb->s_op = &example_super_ops;
-    sb->s_time_gran = 1;
+    inode_lock_nested(dir, I_MUTEX_PARENT);
     
-    root = example_get_inode(sb, S_IFDIR | 0755);
-    if (!root)
-        return -ENOMEM;
+    ret = inode_permission(file_mnt_user_ns(file), dir, MAY_WRITE | MAY_EXEC);
+    if (ret)
+        goto out_unlock;
     
-    sb->s_root = d_make_root(root);
-    if (!sb->s_root)
-        return -ENOMEM;
+    name = names;
+    end = names + req.names_len;
+    for (i = 0; i < req.count; i++) {
+        size_t len;
+        
+        if (name >= end) {
+            ret = -EINVAL;
+            break;
+        }
+        if (i >= allocated) {
+            ret = -ENOSPC;
+            break;
+        }
+        
+        len = strlen(name);
+        if (!example_bulk_name_ok(name, len)) {
+            ret = -EINVAL;
+            break;
+        }
+        
+        dentry = example_lookup_new(name, parent, len);
+        if (IS_ERR(dentry)) {
+            ret = PTR_ERR(dentry);
+            break;
+        }
+        if (d_really_is_positive(dentry)) {
+            dput(dentry);
+            ret = -EEXIST;
+            break;
+        }
+        
+        // The lookup reference becomes the pin example_create() takes with dget()
+        example_d_instantiate(dentry, inodes[i]);
+        fsnotify_create(dir, dentry);
+        inos[i] = inodes[i]->i_ino;
+        inodes[i] = NULL;
+        created++;
+        
+        name += len + 1;
+    }
+    
+    if (created)
+        dir->i_mtime = dir->i_ctime = current_time(dir);
+    
+out_unlock:
+    inode_unlock(dir);
+    
+    for (i = created; i < allocated; i++)
+        if (inodes[i])
+            iput(inodes[i]);
+    
+    mnt_drop_write_file(file);
+    
+    // Report partial progress; the return value says why we stopped
+    if (put_user(created, &uarg->count) ||
+        copy_to_user(u64_to_user_ptr(req.inos), inos, created * sizeof(*inos)))
+        ret = -EFAULT;
+    
+out_free:
+    kvfree(inodes);
+    kvfree(inos);
+    kvfree(names);
+    return ret;
+}
+
+// cpio archives
+//
+// The newc format is what the kernel unpacks into the initramfs, so a
+// mount can be snapshotted straight into a boot image and brought back
+// with import= instead of going through find | cpio.  The tree is flat:
+// the archive holds "." for the root and one entry per regular file.
+// Each file is written from or read into its page cache pages directly,
+// with no bounce buffer in between.
+#define EXAMPLE_CPIO_MAGIC "070701"
+#define EXAMPLE_CPIO_HDR_LEN 110
+#define EXAMPLE_CPIO_TRAILER "TRAILER!!!"
+
+// Header fields, in archive order after the magic
+enum {
+    CPIO_INO, CPIO_MODE, CPIO_UID, CPIO_GID, CPIO_NLINK, CPIO_MTIME,
+    CPIO_FILESIZE, CPIO_DEVMAJOR, CPIO_DEVMINOR, CPIO_RDEVMAJOR,
+    CPIO_RDEVMINOR, CPIO_NAMESIZE, CPIO_CHECK, CPIO_NR_FIELDS,
+};
+
+static int example_export_write(struct file *out, loff_t *pos, const void *buf, size_t len)
+{
+    ssize_t n = kernel_write(out, buf, len, pos);
+    
+    if (n < 0)
+        return n;
+    return n == len ? 0 : -EIO;
+}
+
+// Zeroes that bring the archive offset up to a multiple of 4
+static int example_export_pad(struct file *out, loff_t *pos, loff_t *written)
+{
+    static const char zeroes[4];
+    size_t pad = (4 - (*written & 3)) & 3;
+    
+    *written += pad;
+    return pad ? example_export_write(out, pos, zeroes, pad) : 0;
+}
+
+static int example_export_header(struct file *out, loff_t *pos, loff_t *written,
+                                 char *hdr, struct inode *inode, const char *name,
+                                 size_t name_len, loff_t size)
+{
+    size_t len;
+    int ret;
+    
+    len = scnprintf(hdr, EXAMPLE_CPIO_HDR_LEN + 1,
+                    EXAMPLE_CPIO_MAGIC "%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X",
+                    inode ? (u32)inode->i_ino : 0, inode ? inode->i_mode : 0,
+                    inode ? from_kuid_munged(current_user_ns(), inode->i_uid) : 0,
+                    inode ? from_kgid_munged(current_user_ns(), inode->i_gid) : 0,
+                    inode ? inode->i_nlink : 1,
+                    inode ? (u32)inode->i_mtime.tv_sec : 0,
+                    (u32)size, 0, 0, 0, 0, (u32)name_len + 1, 0);
+    memcpy(hdr + len, name, name_len);
+    hdr[len + name_len] = '\0';
+    len += name_len + 1;
+    
+    ret = example_export_write(out, pos, hdr, len);
+    if (ret)
+        return ret;
+    *written += len;
+    return example_export_pad(out, pos, written);
+}
+
+// Stream @size bytes of @inode: inline data from a snapshot, pages from
+// the page cache through a temporary kernel mapping, holes from the zero page
+static int example_export_data(struct file *out, loff_t *pos, loff_t *written,
+                               struct inode *inode, loff_t size)
+{
+    char ibuf[EXAMPLE_INLINE_MAX];
+    loff_t off, isize;
+    struct page *page;
+    size_t len;
+    void *kaddr;
+    int ret = 0;
+    
+    isize = example_inline_read(inode, ibuf);
+    if (isize >= 0) {
+        ret = example_export_write(out, pos, ibuf, isize);
+        *written += isize;
+        return ret ? ret : example_export_pad(out, pos, written);
+    }
+    
+    for (off = 0; off < size; off += len) {
+        len = min_t(loff_t, PAGE_SIZE, size - off);
+        
+        page = find_get_page(inode->i_mapping, off >> PAGE_SHIFT);
+        if (page) {
+            kaddr = kmap(page);
+            ret = example_export_write(out, pos, kaddr, len);
+            kunmap(page);
+            put_page(page);
+        } else {
+            ret = example_export_write(out, pos, page_address(ZERO_PAGE(0)), len);
+        }
+        if (ret)
+            return ret;
+        
+        if (fatal_signal_pending(current))
+            return -EINTR;
+        cond_resched();
+    }
+    
+    *written += size;
+    return example_export_pad(out, pos, written);
+}
+
+// Next positive child of @parent after @prev (NULL: the first), with a
+// reference held; drops the reference on @prev.  As in libfs, a held
+// dentry stays on d_subdirs, so the walk can sleep between entries.
+static struct dentry *example_next_child(struct dentry *parent, struct dentry *prev)
+{
+    struct list_head *p = prev ? &prev->d_child : &parent->d_subdirs;
+    struct dentry *child, *found = NULL;
+    
+    spin_lock(&parent->d_lock);
+    while ((p = p->next) != &parent->d_subdirs) {
+        child = list_entry(p, struct dentry, d_child);
+        if (child->d_flags & DCACHE_DENTRY_CURSOR)
+            continue;
+        if (simple_positive(child)) {
+            found = dget(child);
+            break;
+        }
+    }
+    spin_unlock(&parent->d_lock);
+    
+    dput(prev);
+    return found;
+}
+
+static long example_export(struct file *file, struct example_export __user *uarg)
+{
+    struct dentry *root = file->f_path.dentry->d_sb->s_root;
+    struct dentry *child = NULL;
+    struct example_export req;
+    struct inode *inode;
+    loff_t written = 0, pos, size;
+    struct fd out;
+    char *hdr;
+    long ret;
+    
+    // The archive holds every file regardless of its permissions
+    if (!capable(CAP_DAC_READ_SEARCH))
+        return -EPERM;
+    
+    if (copy_from_user(&req, uarg, sizeof(req)))
+        return -EFAULT;
+    if (req.flags)
+        return -EINVAL;
+    
+    out = fdget_pos(req.fd);
+    if (!out.file)
+        return -EBADF;
+    
+    // Writing into one of the files being exported would deadlock on it
+    ret = -EINVAL;
+    if (file_inode(out.file)->i_sb == root->d_sb)
+        goto out_put;
+    
+    ret = -ENOMEM;
+    hdr = kmalloc(EXAMPLE_CPIO_HDR_LEN + NAME_MAX + 1, GFP_KERNEL);
+    if (!hdr)
+        goto out_put;
+    
+    pos = out.file->f_pos;
+    
+    // Hold off creates and unlinks for a consistent listing
+    inode_lock_shared(d_inode(root));
+    
+    ret = example_export_header(out.file, &pos, &written, hdr, d_inode(root), ".", 1, 0);
+    
+    while (!ret && (child = example_next_child(root, child))) {
+        inode = d_inode(child);
+        if (!S_ISREG(inode->i_mode))
+            continue;
+        
+        // Shared against writers, so each file is exported whole
+        inode_lock_shared(inode);
+        size = i_size_read(inode);
+        ret = size > U32_MAX ? -EFBIG : 0;     // newc sizes are 32-bit
+        if (!ret)
+            ret = example_export_header(out.file, &pos, &written, hdr, inode,
+                                        child->d_name.name, child->d_name.len, size);
+        if (!ret)
+            ret = example_export_data(out.file, &pos, &written, inode, size);
+        inode_unlock_shared(inode);
+    }
+    dput(child);
+    
+    if (!ret)
+        ret = example_export_header(out.file, &pos, &written, hdr, NULL,
+                                    EXAMPLE_CPIO_TRAILER, sizeof(EXAMPLE_CPIO_TRAILER) - 1, 0);
+    
+    inode_unlock_shared(d_inode(root));
+    
+    if (!(out.file->f_mode & FMODE_STREAM))
+        out.file->f_pos = pos;
+    
+    // Report what made it out even on failure
+    if (put_user(written, &uarg->bytes))
+        ret = -EFAULT;
+    
+    kfree(hdr);
+out_put:
+    fdput_pos(out);
+    return ret;
+}
+
+static int example_cpio_field(const char *hdr, int field, unsigned long *val)
+{
+    char tmp[9];
+    
+    memcpy(tmp, hdr + 6 + field * 8, 8);
+    tmp[8] = '\0';
+    return kstrtoul(tmp, 16, val);
+}
+
+// Fill a new, empty @inode with @size bytes read from @src at @pos.
+// Small files stay inline; larger ones are read straight into their pages.
+static int example_import_data(struct inode *inode, struct file *src, loff_t pos, loff_t size)
+{
+    struct address_space *mapping = inode->i_mapping;
+    char ibuf[EXAMPLE_INLINE_MAX];
+    struct page *page;
+    void *fsdata, *kaddr;
+    loff_t off;
+    ssize_t n;
+    size_t len;
+    int ret;
+    
+    if (size <= EXAMPLE_INLINE_MAX) {
+        if (kernel_read(src, ibuf, size, &pos) != size)
+            return -EIO;
+        // Not yet visible to anyone, so it is still inline
+        example_inline_write(inode, 0, ibuf, size);
+        return 0;
+    }
+    
+    ret = example_inline_to_page(inode);
+    
+    for (off = 0; !ret && off < size; off += len) {
+        len = min_t(loff_t, PAGE_SIZE, size - off);
+        
+        ret = mapping->a_ops->write_begin(NULL, mapping, off, len, &page, &fsdata);
+        if (ret)
+            break;
+        
+        kaddr = kmap(page);
+        n = kernel_read(src, kaddr + offset_in_page(off), len, &pos);
+        kunmap(page);
+        flush_dcache_page(page);
+        
+        ret = mapping->a_ops->write_end(NULL, mapping, off, len, n > 0 ? n : 0, page, fsdata);
+        if (ret >= 0)
+            ret = n == len ? 0 : -EIO;
+        
+        cond_resched();
+    }
+    
+    example_sync_blocks(inode);
+    return ret;
+}
+
+static int example_import_file(struct super_block *sb, struct file *src, loff_t pos,
+                               const char *name, unsigned long *h)
+{
+    struct dentry *root = sb->s_root;
+    struct timespec64 mtime = { .tv_sec = h[CPIO_MTIME] };
+    struct dentry *dentry;
+    struct inode *inode;
+    int ret;
+    
+    inode = example_get_inode(sb, S_IFREG | (h[CPIO_MODE] & S_IALLUGO));
+    if (!inode)
+        return -ENOSPC;
+    
+    inode->i_uid = make_kuid(current_user_ns(), h[CPIO_UID]);
+    inode->i_gid = make_kgid(current_user_ns(), h[CPIO_GID]);
+    if (!uid_valid(inode->i_uid))
+        inode->i_uid = GLOBAL_ROOT_UID;
+    if (!gid_valid(inode->i_gid))
+        inode->i_gid = GLOBAL_ROOT_GID;
+    
+    inode_lock(d_inode(root));
+    dentry = example_lookup_new(name, root, strlen(name));
+    if (IS_ERR(dentry)) {
+        ret = PTR_ERR(dentry);
+    } else if (d_really_is_positive(dentry)) {
+        pr_warn("example_vfs: import: skipping duplicate '%s'\n", name);
+        dput(dentry);
+        ret = 0;
+    } else {
+        // As in bulk create, the lookup reference becomes the pin
+        example_d_instantiate(dentry, inode);
+        inode = NULL;
+        ret = 0;
+    }
+    inode_unlock(d_inode(root));
+    
+    if (inode) {
+        iput(inode);
+        return ret;
+    }
+    
+    inode = d_inode(dentry);
+    inode_lock(inode);
+    ret = example_import_data(inode, src, pos, h[CPIO_FILESIZE]);
+    inode->i_atime = inode->i_mtime = inode->i_ctime = mtime;
+    inode_unlock(inode);
+    
+    return ret;
+}
+
+// Populate a new mount from the uncompressed newc archive at @path.
+// Only "." and regular files are meaningful in a flat tree; anything
+// else is skipped with a warning.
+static int example_import(struct super_block *sb, const char *path)
+{
+    unsigned long h[CPIO_NR_FIELDS];
+    struct file *src;
+    loff_t pos = 0, next;
+    char *hdr, *name;
+    int i, ret = 0;
+    
+    src = filp_open(path, O_RDONLY | O_LARGEFILE, 0);
+    if (IS_ERR(src))
+        return PTR_ERR(src);
+    
+    hdr = kmalloc(EXAMPLE_CPIO_HDR_LEN + NAME_MAX + 3, GFP_KERNEL);
+    if (!hdr) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    name = hdr + EXAMPLE_CPIO_HDR_LEN;
+    
+    for (;;) {
+        if (kernel_read(src, hdr, EXAMPLE_CPIO_HDR_LEN, &pos) != EXAMPLE_CPIO_HDR_LEN ||
+            memcmp(hdr, EXAMPLE_CPIO_MAGIC, 5) || (hdr[5] != '1' && hdr[5] != '2')) {
+            ret = -EINVAL;
+            break;
+        }
+        
+        for (i = 0; i < CPIO_NR_FIELDS; i++)
+            if (example_cpio_field(hdr, i, &h[i]))
+                break;
+        
+        // "./" + NAME_MAX + NUL at most
+        if (i < CPIO_NR_FIELDS || !h[CPIO_NAMESIZE] || h[CPIO_NAMESIZE] > NAME_MAX + 3 ||
+            kernel_read(src, name, h[CPIO_NAMESIZE], &pos) != h[CPIO_NAMESIZE] ||
+            name[h[CPIO_NAMESIZE] - 1] != '\0') {
+            ret = -EINVAL;
+            break;
+        }
+        pos = ALIGN(pos, 4);
+        next = ALIGN(pos + h[CPIO_FILESIZE], 4);
+        
+        if (!strcmp(name, EXAMPLE_CPIO_TRAILER))
+            break;
+        
+        if (!strncmp(name, "./", 2))
+            name += 2;
+        
+        if (S_ISREG(h[CPIO_MODE]) && example_bulk_name_ok(name, strlen(name))) {
+            ret = example_import_file(sb, src, pos, name, h);
+            if (ret)
+                break;
+        } else if (strcmp(name, ".") && *name) {
+            pr_warn("example_vfs: import: skipping '%s'\n", name);
+        }
+        
+        name = hdr + EXAMPLE_CPIO_HDR_LEN;
+        pos = next;
+    }
+    
+    kfree(hdr);
+out:
+    fput(src);
+    if (ret)
+        pr_err("example_vfs: import of %s failed at offset %lld: %d\n", path, pos, ret);
+    return ret;
+}
+
+static long example_dcache_stats(struct file *file, struct example_dcache_stats __user *uarg)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(file_inode(file)->i_sb);
+    struct example_dcache_stats st = {
+        .lookups          = percpu_counter_sum_positive(&sbi->lookups),
+        .negative         = percpu_counter_sum_positive(&sbi->nr_negative),
+        .negative_limit   = sbi->max_negative,
+        .negative_dropped = atomic_long_read(&sbi->negative_dropped),
+        .negative_reused  = atomic_long_read(&sbi->negative_reused),
+    };
+    
+    return copy_to_user(uarg, &st, sizeof(st)) ? -EFAULT : 0;
+}
+
+static long example_dir_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    switch (cmd) {
+    case EXAMPLE_VFS_IOC_BULK_CREATE:
+        return example_bulk_create(file, (struct example_bulk_create __user *)arg);
+    case EXAMPLE_VFS_IOC_DCACHE_STATS:
+        return example_dcache_stats(file, (struct example_dcache_stats __user *)arg);
+    case EXAMPLE_VFS_IOC_EXPORT:
+        return example_export(file, (struct example_export __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+static int example_setattr(struct user_namespace *mnt_userns, struct dentry *dentry,
+                           struct iattr *iattr)
+{
+    struct inode *inode = d_inode(dentry);
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    int ret;
+    
+    ret = setattr_prepare(mnt_userns, dentry, iattr);
+    if (ret)
+        return ret;
+    
+    // Growing only moves i_size; pages appear when they are written
+    if ((iattr->ia_valid & ATTR_SIZE) && iattr->ia_size != i_size_read(inode)) {
+        loff_t oldsize = inode->i_size;
+        
+        if (iattr->ia_size > EXAMPLE_INLINE_MAX) {
+            ret = example_inline_to_page(inode);
+            if (ret)
+                return ret;
+        }
+        
+        if (!ei->data_inline || !example_inline_truncate(inode, iattr->ia_size)) {
+            // truncate_setsize(), with the size published through size_seq
+            example_size_write(inode, iattr->ia_size);
+            if (iattr->ia_size > oldsize)
+                pagecache_isize_extended(inode, oldsize, iattr->ia_size);
+            truncate_pagecache(inode, iattr->ia_size);
+            example_sync_blocks(inode);
+        }
+        inode->i_mtime = inode->i_ctime = current_time(inode);
+    }
+    
+    setattr_copy(mnt_userns, inode, iattr);
+    mark_inode_dirty(inode);
+    return 0;
+}
+
+// Address Space Operations Implementation
+
+// Only reached for folios no write put in the cache: holes, which read as
+// zeroes, and index 0 of an inline file faulted in through mmap, which is
+// where its data moves to the page cache.  A huge= folio is filled whole.
+static int example_read_folio(struct file *file, struct folio *folio)
+{
+    struct inode *inode = folio->mapping->host;
+    
+    if (folio->index == 0 && example_inline_fill_folio(inode, folio)) {
+        // Now the only copy of the data: keep it away from invalidation
+        folio_mark_dirty(folio);
+    } else {
+        folio_zero_range(folio, 0, folio_size(folio));
+    }
+    
+    flush_dcache_folio(folio);
+    folio_mark_uptodate(folio);
+    folio_unlock(folio);
+    return 0;
+}
+
+// Charge a page against size= before it is added to the page cache.
+// Writers hold the inode lock, so the lookup cannot race with another
+// writer instantiating the same page.  With huge=always the page comes
+// from a zeroed PMD folio that later writes to the range fill in.
+static int example_write_begin(struct file *file, struct address_space *mapping,
+                               loff_t pos, unsigned len,
+                               struct page **pagep, void **fsdata)
+{
+    struct inode *inode = mapping->host;
+    struct folio *folio = NULL;
+    struct page *page;
+    
+    page = find_get_page(mapping, pos >> PAGE_SHIFT);
+    if (page) {
+        put_page(page);
+    } else {
+        if (EXAMPLE_SB(inode->i_sb)->huge == EXAMPLE_HUGE_ALWAYS)
+            folio = example_alloc_huge(inode, pos >> PAGE_SHIFT);
+        if (folio) {
+            EXAMPLE_I(inode)->nr_blocks += folio_nr_pages(folio);
+            folio_zero_range(folio, 0, folio_size(folio));
+            folio_mark_uptodate(folio);
+            folio_unlock(folio);
+            folio_put(folio);
+        } else {
+            if (example_reserve_blocks(inode->i_sb, 1))
+                return -ENOSPC;
+            EXAMPLE_I(inode)->nr_blocks++;
+        }
+    }
+    
+    // If this fails the charge is settled by the caller's example_sync_blocks()
+    return simple_write_begin(file, mapping, pos, len, pagep, fsdata);
+}
+
+// simple_write_end(), except that an extending write publishes the new
+// size through example_size_write() once the copied data is in the page
+static int example_write_end(struct file *file, struct address_space *mapping,
+                             loff_t pos, unsigned len, unsigned copied,
+                             struct page *page, void *fsdata)
+{
+    struct inode *inode = mapping->host;
+    loff_t last_pos = pos + copied;
+    
+    // Zero the stale part of the page if we did a short copy
+    if (!PageUptodate(page)) {
+        if (copied < len)
+            zero_user(page, offset_in_page(pos) + copied, len - copied);
+        SetPageUptodate(page);
+    }
+    
+    // i_size cannot change under us: we hold the inode lock
+    if (last_pos > inode->i_size)
+        example_size_write(inode, last_pos);
+    
+    set_page_dirty(page);
+    unlock_page(page);
+    put_page(page);
+    
+    return copied;
+}
+
+// Extended Attributes
+//
+// Each inode keeps its attributes in one array sorted by full name, so
+// lookups are a binary search over contiguous entries.  Name and value
+// share a buffer that lives inside the entry when small, which covers the
+// usual security.* labels and user.* tags without a per-attribute
+// allocation.  Writers are serialized by the inode lock the VFS holds
+// around setxattr/removexattr; xattr_lock only keeps readers consistent.
+static inline char *example_xattr_name(struct example_xattr *xa)
+{
+    return xa->ext ? xa->ext : xa->inline_buf;
+}
+
+static inline void *example_xattr_value(struct example_xattr *xa)
+{
+    return example_xattr_name(xa) + xa->name_len + 1;
+}
+
+// Returns the index of @name, or -(insertion point) - 1 if absent
+static int example_xattr_find(struct example_inode_info *ei, const char *name)
+{
+    int lo = 0, hi = (int)ei->xattr_count - 1;
+    
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(name, example_xattr_name(&ei->xattrs[mid]));
+        
+        if (!cmp)
+            return mid;
+        if (cmp < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+    
+    return -lo - 1;
+}
+
+static int example_xattr_fill(struct example_xattr *xa, const char *name,
+                              const void *value, size_t size)
+{
+    size_t name_len = strlen(name);
+    char *buf = xa->inline_buf;
+    
+    if (name_len + 1 + size > EXAMPLE_XATTR_INLINE) {
+        buf = kmalloc(name_len + 1 + size, GFP_KERNEL);
+        if (!buf)
+            return -ENOMEM;
+        xa->ext = buf;
+    }
+    
+    xa->name_len = name_len;
+    xa->size = size;
+    memcpy(buf, name, name_len + 1);
+    memcpy(buf + name_len + 1, value, size);
+    return 0;
+}
+
+static void example_xattr_free_all(struct example_inode_info *ei)
+{
+    unsigned int i;
+    
+    for (i = 0; i < ei->xattr_count; i++)
+        kfree(ei->xattrs[i].ext);
+    kfree(ei->xattrs);
+    ei->xattrs = NULL;
+    ei->xattr_count = ei->xattr_cap = 0;
+}
+
+static int example_xattr_get(const struct xattr_handler *handler,
+                             struct dentry *unused, struct inode *inode,
+                             const char *name, void *buffer, size_t size)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    struct example_xattr *xa;
+    int idx, ret;
+    
+    spin_lock(&ei->xattr_lock);
+    idx = example_xattr_find(ei, xattr_full_name(handler, name));
+    if (idx < 0) {
+        ret = -ENODATA;
+        goto out;
+    }
+    
+    xa = &ei->xattrs[idx];
+    ret = xa->size;
+    if (size) {
+        if (size < xa->size)
+            ret = -ERANGE;
+        else
+            memcpy(buffer, example_xattr_value(xa), xa->size);
+    }
+    
+out:
+    spin_unlock(&ei->xattr_lock);
+    return ret;
+}
+
+static int example_xattr_set(const struct xattr_handler *handler,
+                             struct user_namespace *mnt_userns,
+                             struct dentry *unused, struct inode *inode,
+                             const char *name, const void *value,
+                             size_t size, int flags)
+{
+    struct example_inode_info *ei = EXAMPLE_I(inode);
+    const char *full = xattr_full_name(handler, name);
+    struct example_xattr new_xa = {}, old_xa = {};
+    struct example_xattr *grown = NULL, *old_array = NULL;
+    unsigned int cap = 0;
+    int idx, pos, ret;
+    
+    // We are the only writer, so the array can be searched without the lock
+    idx = example_xattr_find(ei, full);
+    if (idx >= 0 && (flags & XATTR_CREATE))
+        return -EEXIST;
+    if (idx < 0 && ((flags & XATTR_REPLACE) || !value))
+        return -ENODATA;
+    
+    if (value) {
+        ret = example_xattr_fill(&new_xa, full, value, size);
+        if (ret)
+            return ret;
+    }
+    
+    if (idx < 0 && ei->xattr_count == ei->xattr_cap) {
+        cap = ei->xattr_cap ? ei->xattr_cap * 2 : 4;
+        grown = kmalloc_array(cap, sizeof(*grown), GFP_KERNEL);
+        if (!grown) {
+            kfree(new_xa.ext);
+            return -ENOMEM;
+        }
+        memcpy(grown, ei->xattrs, ei->xattr_count * sizeof(struct example_xattr));
+    }
+    
+    spin_lock(&ei->xattr_lock);
+    if (grown) {
+        old_array = ei->xattrs;
+        ei->xattrs = grown;
+        ei->xattr_cap = cap;
+    }
+    
+    if (idx >= 0) {
+        old_xa = ei->xattrs[idx];
+        if (value) {
+            ei->xattrs[idx] = new_xa;
+        } else {
+            memmove(&ei->xattrs[idx], &ei->xattrs[idx + 1],
+                    (ei->xattr_count - idx - 1) * sizeof(struct example_xattr));
+            ei->xattr_count--;
+        }
+    } else {
+        pos = -idx - 1;
+        memmove(&ei->xattrs[pos + 1], &ei->xattrs[pos],
+                (ei->xattr_count - pos) * sizeof(struct example_xattr));
+        ei->xattrs[pos] = new_xa;
+        ei->xattr_count++;
+    }
+    spin_unlock(&ei->xattr_lock);
+    
+    kfree(old_array);
+    kfree(old_xa.ext);
+    
+    inode->i_ctime = current_time(inode);
+    return 0;
+}
+
+static ssize_t example_listxattr(struct dentry *dentry, char *buffer, size_t size)
+{
+    struct example_inode_info *ei = EXAMPLE_I(d_inode(dentry));
+    bool trusted = capable(CAP_SYS_ADMIN);
+    ssize_t total = 0;
+    unsigned int i;
+    
+    spin_lock(&ei->xattr_lock);
+    for (i = 0; i < ei->xattr_count; i++) {
+        struct example_xattr *xa = &ei->xattrs[i];
+        char *name = example_xattr_name(xa);
+        
+        if (!trusted && !strncmp(name, XATTR_TRUSTED_PREFIX, XATTR_TRUSTED_PREFIX_LEN))
+            continue;
+        
+        if (buffer) {
+            if (total + xa->name_len + 1 > size) {
+                total = -ERANGE;
+                break;
+            }
+            memcpy(buffer + total, name, xa->name_len + 1);
+        }
+        total += xa->name_len + 1;
+    }
+    spin_unlock(&ei->xattr_lock);
+    
+    return total;
+}
+
+static const struct xattr_handler example_xattr_user_handler = {
+    .prefix = XATTR_USER_PREFIX,
+    .get    = example_xattr_get,
+    .set    = example_xattr_set,
+};
+
+static const struct xattr_handler example_xattr_security_handler = {
+    .prefix = XATTR_SECURITY_PREFIX,
+    .get    = example_xattr_get,
+    .set    = example_xattr_set,
+};
+
+static const struct xattr_handler example_xattr_trusted_handler = {
+    .prefix = XATTR_TRUSTED_PREFIX,
+    .get    = example_xattr_get,
+    .set    = example_xattr_set,
+};
+
+static const struct xattr_handler *example_xattr_handlers[] = {
+    &example_xattr_user_handler,
+    &example_xattr_security_handler,
+    &example_xattr_trusted_handler,
+    NULL,
+};
+
+// File Operations Implementation
+static int example_open(struct inode *inode, struct file *file)
+{
+    u64 start = example_trace_start(trace_example_vfs_open_enabled());
+    int ret;
+    
+    // Reads never wait for I/O and writes only for the inode lock, so both
+    // honor IOCB_NOWAIT; io_uring can then complete them inline
+    file->f_mode |= FMODE_NOWAIT | FMODE_BUF_RASYNC;
+    ret = generic_file_open(inode, file);
+    
+    trace_example_vfs_open(inode, file, ret, start);
+    return ret;
+}
+
+// A fault on a page that is not cached yet instantiates it here, charged
+// against size= like a write would be, and only then lets filemap_fault()
+// map it.  Left to filemap_fault(), holes and the inline page would come
+// in through readahead uncharged, and since pages are never reclaimed a
+// mapping could grow the file past the mount's limit.  Like shmem, running
+// out of space is a SIGBUS.  The inode lock can't be taken under
+// mmap_lock, so the charge is parked in fault_blocks; a fault racing for
+// the same page may charge it twice until example_sync_blocks() settles.
+//
+// huge=: a PMD-aligned part of a VM_HUGEPAGE mapping over a PMD-aligned
+// range of the file inside EOF is instantiated as one PMD folio, which
+// finish_fault() then maps with a single PMD.
+static vm_fault_t example_vm_fault(struct vm_fault *vmf)
+{
+    struct inode *inode = file_inode(vmf->vma->vm_file);
+    struct address_space *mapping = inode->i_mapping;
+    struct folio *folio = NULL;
+    struct page *page;
+    
+    page = find_get_page(mapping, vmf->pgoff);
+    if (page) {
+        put_page(page);
+        return filemap_fault(vmf);
+    }
+    
+    // Past EOF filemap_fault() raises SIGBUS without caching anything
+    if (vmf->pgoff >= DIV_ROUND_UP(i_size_read(inode), PAGE_SIZE))
+        return filemap_fault(vmf);
+    
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    if (EXAMPLE_SB(inode->i_sb)->huge != EXAMPLE_HUGE_NEVER &&
+        (vmf->vma->vm_flags & VM_HUGEPAGE) &&
+        transhuge_vma_suitable(vmf->vma, vmf->address & HPAGE_PMD_MASK) &&
+        round_up(vmf->pgoff + 1, HPAGE_PMD_NR) <= i_size_read(inode) >> PAGE_SHIFT)
+        folio = example_alloc_huge(inode, vmf->pgoff);
+#endif
+    if (folio) {
+        atomic_long_add(folio_nr_pages(folio), &EXAMPLE_I(inode)->fault_blocks);
+        example_read_folio(vmf->vma->vm_file, folio);
+        folio_put(folio);
+        return filemap_fault(vmf);
+    }
+    
+    if (example_reserve_blocks(inode->i_sb, 1))
+        return VM_FAULT_SIGBUS;
+    atomic_long_inc(&EXAMPLE_I(inode)->fault_blocks);
+    
+    page = find_or_create_page(mapping, vmf->pgoff, mapping_gfp_mask(mapping));
+    if (!page)
+        return VM_FAULT_OOM;
+    if (PageUptodate(page))
+        unlock_page(page);
+    else
+        example_read_folio(vmf->vma->vm_file, page_folio(page));
+    put_page(page);
+    
+    return filemap_fault(vmf);
+}
+
+static const struct vm_operations_struct example_vm_ops = {
+    .fault          = example_vm_fault,
+    .map_pages      = filemap_map_pages,
+    .page_mkwrite   = filemap_page_mkwrite,
+};
+
+// Mappings go through example_vm_fault(), and everything already cached
+// is mapped in batches by filemap_map_pages() fault-around, PMD folios
+// with one PMD each.  huge=always treats every mapping as MADV_HUGEPAGE.
+static int example_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    int ret;
+    
+    ret = generic_file_mmap(file, vma);
+    if (ret)
+        return ret;
+    
+    vma->vm_ops = &example_vm_ops;
+    if (EXAMPLE_SB(file_inode(file)->i_sb)->huge == EXAMPLE_HUGE_ALWAYS)
+        vma->vm_flags |= VM_HUGEPAGE;
+    return 0;
+}
+
+// PMD-align mappings on huge= mounts so PMD folios can be mapped whole
+static unsigned long example_get_unmapped_area(struct file *file, unsigned long addr,
+                                               unsigned long len, unsigned long pgoff,
+                                               unsigned long flags)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    if (EXAMPLE_SB(file_inode(file)->i_sb)->huge != EXAMPLE_HUGE_NEVER)
+        return thp_get_unmapped_area(file, addr, len, pgoff, flags);
+#endif
+    return current->mm->get_unmapped_area(file, addr, len, pgoff, flags);
+}
+
+// Copy straight out of the page cache, shmem-style.  Every cached page is
+// uptodate except while a writer sits between write_begin and write_end,
+// and holes are returned as zeroes instead of instantiating pages, so
+// the only thing a read can wait for is that short window.
+static ssize_t example_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct file *file = iocb->ki_filp;
+    struct inode *inode = file_inode(file);
+    struct address_space *mapping = inode->i_mapping;
+    u64 start = example_trace_start(trace_example_vfs_read_enabled());
+    size_t count = iov_iter_count(to);
+    char ibuf[EXAMPLE_INLINE_MAX];
+    loff_t pos = iocb->ki_pos;
+    loff_t isize;
+    ssize_t copied = 0;
+    int error = 0;
+    
+    isize = example_inline_read(inode, ibuf);
+    if (isize >= 0) {
+        if (pos < isize && count) {
+            copied = copy_to_iter(ibuf + pos, isize - pos, to);
+            pos += copied;
+            if (!copied)
+                error = -EFAULT;
+        }
+        goto out;
+    }
+    
+    while (iov_iter_count(to)) {
+        loff_t size = example_size_read(inode);
+        size_t offset = offset_in_page(pos);
+        size_t chunk, n;
+        struct page *page;
+        
+        if (pos >= size)
+            break;
+        chunk = min_t(loff_t, PAGE_SIZE - offset, size - pos);
+        
+        page = find_get_page(mapping, pos >> PAGE_SHIFT);
+        if (page && !PageUptodate(page)) {
+            if (iocb->ki_flags & IOCB_NOWAIT)
+                error = -EAGAIN;
+            else
+                error = wait_on_page_locked_killable(page);
+            if (error) {
+                put_page(page);
+                break;
+            }
+        }
+        
+        if (page) {
+            if (mapping_writably_mapped(mapping))
+                flush_dcache_page(page);
+            n = copy_page_to_iter(page, offset, chunk, to);
+            put_page(page);
+        } else {
+            n = iov_iter_zero(chunk, to);
+        }
+        
+        copied += n;
+        pos += n;
+        if (n < chunk) {
+            error = -EFAULT;
+            break;
+        }
+        cond_resched();
+    }
+    
+out:
+    trace_example_vfs_read(inode, iocb->ki_pos, count, copied ? copied : error, start);
+    
+    iocb->ki_pos = pos;
+    file_accessed(file);
+    return copied ? copied : error;
+}
+
+static ssize_t example_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct file *file = iocb->ki_filp;
+    struct inode *inode = file_inode(file);
+    u64 start = example_trace_start(trace_example_vfs_write_enabled());
+    size_t count = iov_iter_count(from);
+    loff_t pos = iocb->ki_pos;
+    char ibuf[EXAMPLE_INLINE_MAX];
+    ssize_t ret;
+    
+    if (iocb->ki_flags & IOCB_NOWAIT) {
+        if (!inode_trylock(inode)) {
+            trace_example_vfs_write(inode, pos, count, -EAGAIN, start);
+            return -EAGAIN;
+        }
+    } else {
+        inode_lock(inode);
+    }
+    
+    ret = generic_write_checks(iocb, from);
+    if (ret <= 0)
+        goto out;
+    
+    // Stripping setuid bits goes through notify_change(); punt that to a worker
+    if (!IS_NOSEC(inode) && (iocb->ki_flags & IOCB_NOWAIT)) {
+        ret = -EAGAIN;
+        goto out;
+    }
+    
+    ret = file_remove_privs(file);
+    if (ret)
+        goto out;
+    
+    ret = file_update_time(file);
+    if (ret)
+        goto out;
+    
+    pos = iocb->ki_pos;
+    
+    // Stage the user data first: size_seq writers cannot take page faults
+    if (EXAMPLE_I(inode)->data_inline && pos + iov_iter_count(from) <= EXAMPLE_INLINE_MAX) {
+        ret = copy_from_iter(ibuf, iov_iter_count(from), from);
+        if (!ret) {
+            ret = -EFAULT;
+            goto out;
+        }
+        if (example_inline_write(inode, pos, ibuf, ret)) {
+            iocb->ki_pos += ret;
+            goto out;
+        }
+        // Moved to the page cache by an mmap fault meanwhile
+        iov_iter_revert(from, ret);
+    }
+    
+    ret = example_inline_to_page(inode);
+    if (ret)
+        goto out;
+    
+    ret = generic_perform_write(iocb, from);
+    if (ret > 0)
+        iocb->ki_pos += ret;
+    
+out:
+    example_sync_blocks(inode);
+    inode_unlock(inode);
+    
+    if (ret > 0)
+        ret = generic_write_sync(iocb, ret);
+    
+    trace_example_vfs_write(inode, pos, count, ret, start);
+    return ret;
+}
+
+// Copy a range between two example_vfs files page cache to page cache.
+//
+// Page cache pages belong to exactly one mapping, so the pages themselves
+// cannot be shared between files the way a reflink would; instead each
+// source page is copied straight into the destination page, without the
+// pipe the VFS splice fallback would go through.  Source holes are skipped
+// rather than filled, so sparse files stay sparse.  The VFS has already
+// clamped @len to the source size and rejected overlapping ranges.
+//
+// Copies from an inline file, or small enough to leave the destination
+// inline, go through the generic splice copy (read_iter/write_iter) instead,
+// which is cheap at that size.
+static ssize_t example_copy_file_range(struct file *file_in, loff_t pos_in,
+                                       struct file *file_out, loff_t pos_out,
+                                       size_t len, unsigned int flags)
+{
+    struct inode *src = file_inode(file_in);
+    struct inode *dst = file_inode(file_out);
+    struct address_space *mapping = dst->i_mapping;
+    ssize_t copied = 0;
+    int ret;
+    
+    lock_two_nondirectories(src, dst);
+    
+    len = min_t(loff_t, len, max_t(loff_t, i_size_read(src) - pos_in, 0));
+    
+    if (EXAMPLE_I(src)->data_inline ||
+        (EXAMPLE_I(dst)->data_inline && pos_out + len <= EXAMPLE_INLINE_MAX)) {
+        unlock_two_nondirectories(src, dst);
+        return generic_copy_file_range(file_in, pos_in, file_out, pos_out, len, flags);
+    }
+    
+    ret = file_remove_privs(file_out);
+    if (ret)
+        goto out;
+    
+    ret = example_inline_to_page(dst);
+    if (ret)
+        goto out;
+    
+    while (len) {
+        size_t chunk = min_t(size_t, len, min(PAGE_SIZE - offset_in_page(pos_in),
+                                              PAGE_SIZE - offset_in_page(pos_out)));
+        struct page *src_page, *dst_page;
+        void *fsdata, *from, *to;
+        
+        if (fatal_signal_pending(current)) {
+            ret = -EINTR;
+            break;
+        }
+        
+        src_page = find_get_page(src->i_mapping, pos_in >> PAGE_SHIFT);
+        if (!src_page) {
+            // Source hole: only the destination's existing data needs zeroing
+            dst_page = find_get_page(mapping, pos_out >> PAGE_SHIFT);
+            if (!dst_page)
+                goto next;
+            put_page(dst_page);
+        }
+        
+        ret = mapping->a_ops->write_begin(file_out, mapping, pos_out, chunk,
+                                          &dst_page, &fsdata);
+        if (ret) {
+            if (src_page)
+                put_page(src_page);
+            break;
+        }
+        
+        to = kmap_local_page(dst_page);
+        if (src_page) {
+            from = kmap_local_page(src_page);
+            memcpy(to + offset_in_page(pos_out), from + offset_in_page(pos_in), chunk);
+            kunmap_local(from);
+            put_page(src_page);
+        } else {
+            memset(to + offset_in_page(pos_out), 0, chunk);
+        }
+        kunmap_local(to);
+        flush_dcache_page(dst_page);
+        
+        ret = mapping->a_ops->write_end(file_out, mapping, pos_out, chunk, chunk,
+                                        dst_page, fsdata);
+        if (ret < 0)
+            break;
+        
+next:
+        pos_in += chunk;
+        pos_out += chunk;
+        len -= chunk;
+        copied += chunk;
+        cond_resched();
+    }
+    
+    // Skipped holes at the tail still extend the destination
+    if (copied && pos_out > i_size_read(dst))
+        example_size_write(dst, pos_out);
+    
+    if (copied) {
+        dst->i_mtime = dst->i_ctime = current_time(dst);
+        example_sync_blocks(dst);
+    }
+    
+out:
+    unlock_two_nondirectories(src, dst);
+    return copied ? copied : ret;
+}
+
+// Sparse files
+//
+// A file's pages sit in the page cache xarray indexed by page offset, and
+// a missing index is a hole that reads back as zeroes (see
+// example_read_iter()).  Preallocation, hole punching and SEEK_DATA/
+// SEEK_HOLE are therefore all xarray operations on i_mapping->i_pages,
+// with no data copied.
+
+// Instantiate zeroed pages over [offset, offset + len), charging each new one
+static int example_prealloc(struct inode *inode, loff_t offset, loff_t len)
+{
+    struct address_space *mapping = inode->i_mapping;
+    pgoff_t index = offset >> PAGE_SHIFT;
+    pgoff_t last = (offset + len - 1) >> PAGE_SHIFT;
+    struct page *page;
+    
+    for (; index <= last; index++) {
+        if (fatal_signal_pending(current))
+            return -EINTR;
+        
+        page = find_lock_page(mapping, index);
+        if (!page) {
+            if (example_reserve_blocks(inode->i_sb, 1))
+                return -ENOSPC;
+            EXAMPLE_I(inode)->nr_blocks++;
+            
+            page = find_or_create_page(mapping, index, mapping_gfp_mask(mapping));
+            if (!page)
+                return -ENOMEM;
+        }
+        
+        if (!PageUptodate(page)) {
+            clear_highpage(page);
+            flush_dcache_page(page);
+            SetPageUptodate(page);
+        }
+        set_page_dirty(page);
+        unlock_page(page);
+        put_page(page);
+        
+        cond_resched();
+    }
+    
+    return 0;
+}
+
+static long example_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
+{
+    struct inode *inode = file_inode(file);
+    loff_t end = offset + len;
+    long ret;
+    
+    if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE))
+        return -EOPNOTSUPP;
+    
+    inode_lock(inode);
+    
+    if (!(mode & FALLOC_FL_KEEP_SIZE) && end > i_size_read(inode)) {
+        ret = inode_newsize_ok(inode, end);
+        if (ret)
+            goto out;
+    }
+    
+    ret = file_remove_privs(file);
+    if (ret)
+        goto out;
+    
+    ret = example_inline_to_page(inode);
+    if (ret)
+        goto out;
+    
+    // Whole pages are dropped from the xarray, partial ones zeroed in place
+    if (mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE))
+        truncate_pagecache_range(inode, offset, end - 1);
+    
+    // A zeroed range stays allocated, so refill it with fresh zero pages
+    if (!(mode & FALLOC_FL_PUNCH_HOLE))
+        ret = example_prealloc(inode, offset, len);
+    
+    if (!ret && !(mode & FALLOC_FL_KEEP_SIZE) && end > i_size_read(inode))
+        example_size_write(inode, end);
+    
+    inode->i_mtime = inode->i_ctime = current_time(inode);
+    
+out:
+    example_sync_blocks(inode);
+    inode_unlock(inode);
+    return ret;
+}
+
+// Page-granular SEEK_DATA/SEEK_HOLE over the page cache xarray.  Both ends
+// are clamped to [start, size], which also covers page_cache_next_miss()
+// returning an index past the range when there is no gap in it.
+static loff_t example_seek_hole_data(struct inode *inode, loff_t start, int whence)
+{
+    struct xarray *xa = &inode->i_mapping->i_pages;
+    loff_t size = i_size_read(inode);
+    unsigned long index, last;
+    
+    if (start < 0 || start >= size)
+        return -ENXIO;
+    
+    // An inline file is data up to EOF
+    if (EXAMPLE_I(inode)->data_inline)
+        return whence == SEEK_DATA ? start : size;
+    
+    index = start >> PAGE_SHIFT;
+    last = (size - 1) >> PAGE_SHIFT;
+    
+    if (whence == SEEK_DATA) {
+        if (!xa_find(xa, &index, last, XA_PRESENT))
+            return -ENXIO;
+        return max_t(loff_t, start, (loff_t)index << PAGE_SHIFT);
+    }
+    
+    // SEEK_HOLE: the end of the run of present pages starting at @index.
+    // page_cache_next_miss() steps over multi-page entries as a whole.
+    index = page_cache_next_miss(inode->i_mapping, index, last - index + 1);
+    
+    // Past the last page the implicit hole at EOF is the answer
+    return min_t(loff_t, max_t(loff_t, start, (loff_t)index << PAGE_SHIFT), size);
+}
+
+static loff_t example_llseek(struct file *file, loff_t offset, int whence)
+{
+    struct inode *inode = file_inode(file);
+    
+    if (whence != SEEK_DATA && whence != SEEK_HOLE)
+        return generic_file_llseek(file, offset, whence);
+    
+    // Keep punches and writes from reshaping the file mid-walk
+    inode_lock_shared(inode);
+    offset = example_seek_hole_data(inode, offset, whence);
+    inode_unlock_shared(inode);
+    
+    if (offset < 0)
+        return offset;
+    return vfs_setpos(file, offset, inode->i_sb->s_maxbytes);
+}
+
+// Filesystem mount and unmount
+//
+// Each mount gets its own example_sb_info: init_fs_context() allocates it,
+// mount options are parsed straight into it, and get_tree_nodev() hands it
+// to the new superblock as s_fs_info.  Limits, usage counters, the
+// negative dentry bound and the inode number allocator are all in there,
+// so independent instances share nothing but the inode slab.
+enum {
+    Opt_size,
+    Opt_nr_inodes,
+    Opt_nr_negative,
+    Opt_casefold,
+    Opt_import,
+    Opt_huge,
+};
+
+static const struct constant_table example_param_huge[] = {
+    { "never",  EXAMPLE_HUGE_NEVER },
+    { "always", EXAMPLE_HUGE_ALWAYS },
+    { "advise", EXAMPLE_HUGE_ADVISE },
+    {}
+};
+
+static const struct fs_parameter_spec example_fs_parameters[] = {
+    fsparam_string("size",        Opt_size),
+    fsparam_string("nr_inodes",   Opt_nr_inodes),
+    fsparam_string("nr_negative", Opt_nr_negative),
+    fsparam_flag("casefold",      Opt_casefold),
+    fsparam_string("import",      Opt_import),
+    fsparam_enum("huge",          Opt_huge, example_param_huge),
+    {}
+};
+
+static int example_parse_param(struct fs_context *fc, struct fs_parameter *param)
+{
+    struct example_sb_info *sbi = fc->s_fs_info;
+    struct fs_parse_result result;
+    unsigned long long value;
+    char *rest;
+    int opt;
+    
+    opt = fs_parse(fc, example_fs_parameters, param, &result);
+    if (opt < 0)
+        return opt;
+    
+    switch (opt) {
+    case Opt_size:
+        // Accepts the usual k/m/g suffixes
+        value = memparse(param->string, &rest);
+        if (*rest)
+            goto bad_value;
+        sbi->max_blocks = DIV_ROUND_UP(value, PAGE_SIZE);
+        break;
+    case Opt_nr_inodes:
+        value = memparse(param->string, &rest);
+        if (*rest)
+            goto bad_value;
+        sbi->max_inodes = value;
+        break;
+    case Opt_nr_negative:
+        value = memparse(param->string, &rest);
+        if (*rest)
+            goto bad_value;
+        sbi->max_negative = value;
+        break;
+    case Opt_casefold:
+        sbi->casefold = true;
+        break;
+    case Opt_import:
+        kfree(sbi->import);
+        sbi->import = param->string;
+        param->string = NULL;
+        break;
+    case Opt_huge:
+        sbi->huge = result.uint_32;
+        break;
+    }
+    
+    return 0;
+    
+bad_value:
+    return invalfc(fc, "bad value for mount option '%s'", param->key);
+}
+
+static int example_fill_super(struct super_block *sb, struct fs_context *fc)
+{
+    // Moved here from fc by sget_fc(); freed by example_kill_sb(), which
+    // also runs when we fail here
+    struct example_sb_info *sbi = EXAMPLE_SB(sb);
+    struct inode *root;
+    int ret;
+    
+    pr_info("example_vfs: fill_super called\n");
+    
+    spin_lock_init(&sbi->ino_lock);
+    sbi->ino_batch = alloc_percpu(ino_t);
+    if (!sbi->ino_batch)
+        return -ENOMEM;
+    
+    ret = percpu_counter_init(&sbi->used_blocks, 0, GFP_KERNEL);
+    if (ret)
+        return ret;
+    ret = percpu_counter_init(&sbi->used_inodes, 0, GFP_KERNEL);
+    if (ret)
+        return ret;
+    ret = percpu_counter_init(&sbi->nr_negative, 0, GFP_KERNEL);
+    if (ret)
+        return ret;
+    ret = percpu_counter_init(&sbi->lookups, 0, GFP_KERNEL);
+    if (ret)
+        return ret;
+    
+    sb->s_blocksize = PAGE_SIZE;
+    sb->s_blocksize_bits = PAGE_SHIFT;
+    sb->s_maxbytes = MAX_LFS_FILESIZE;
+    sb->s_magic = SIMPLE_MAGIC;
+    sb->s_op = &example_super_ops;
+    sb->s_xattr = example_xattr_handlers;
+    // Before d_make_root(): every dentry takes its ops from here
+    sb->s_d_op = sbi->casefold ? &example_ci_dentry_ops : &example_dentry_ops;
+    sb->s_time_gran = 1;
+    
+    root = example_get_inode(sb, S_IFDIR | 0755);
+    if (!root)
+        return -ENOMEM;
+    
+    sb->s_root = d_make_root(root);
+    if (!sb->s_root)
+        return -ENOMEM;
+    
+    // One-shot: the archive is not remembered past the mount
+    if (sbi->import) {
+        ret = example_import(sb, sbi->import);
+        kfree(sbi->import);
+        sbi->import = NULL;
+        if (ret)
+            return ret;
+    }
     
     pr_info("example_vfs: superblock created successfully\n");
     return 0;
 }
 
-static struct dentry *example_mount(struct file_system_type *fs_type, int flags,
-                                   const char *dev_name, void *data)
+static int example_get_tree(struct fs_context *fc)
 {
     pr_info("example_vfs: mount called\n");
-    return mount_nodev(fs_type, flags, data, example_fill_super);
+    return get_tree_nodev(fc, example_fill_super);
+}
+
+// Only still set if no superblock took the private data
+static void example_free_fc(struct fs_context *fc)
+{
+    struct example_sb_info *sbi = fc->s_fs_info;
+    
+    if (sbi)
+        kfree(sbi->import);
+    kfree(sbi);
+}
+
+static const struct fs_context_operations example_context_ops = {
+    .free        = example_free_fc,
+    .parse_param = example_parse_param,
+    .get_tree    = example_get_tree,
+};
+
+static int example_init_fs_context(struct fs_context *fc)
+{
+    struct example_sb_info *sbi;
+    
+    sbi = kzalloc(sizeof(*sbi), GFP_KERNEL);
+    if (!sbi)
+        return -ENOMEM;
+    
+    sbi->max_negative = EXAMPLE_NEG_DEFAULT;
+    
+    fc->s_fs_info = sbi;
+    fc->ops = &example_context_ops;
+    return 0;
+}
+
+static void example_kill_sb(struct super_block *sb)
+{
+    struct example_sb_info *sbi = EXAMPLE_SB(sb);
+    
+    kill_litter_super(sb);
+    
+    // After kill_litter_super(): freeing the dentries gives back their slots
+    if (sbi) {
+        percpu_counter_destroy(&sbi->lookups);
+        percpu_counter_destroy(&sbi->nr_negative);
+        percpu_counter_destroy(&sbi->used_inodes);
+        percpu_counter_destroy(&sbi->used_blocks);
+        free_percpu(sbi->ino_batch);
+        kfree(sbi->import);
+        kfree(sbi);
+    }
 }
 
 static struct file_system_type example_fs_type = {
     .owner      = THIS_MODULE,
     .name       = "example_vfs",
-    .mount      = example_mount,
-    .kill_sb    = kill_litter_super,
+    .init_fs_context = example_init_fs_context,
+    .parameters = example_fs_parameters,
+    .kill_sb    = example_kill_sb,
 };
 
 static int __init example_vfs_init(void)
 {
-    int ret = register_filesystem(&example_fs_type);
-    if (ret)
+    int ret;
+    
+    example_inode_cachep = kmem_cache_create("example_inode_cache",
+                                             sizeof(struct example_inode_info), 0,
+                                             SLAB_RECLAIM_ACCOUNT | SLAB_MEM_SPREAD | SLAB_ACCOUNT,
+                                             example_inode_init_once);
+    if (!example_inode_cachep) {
+        pr_err("example_vfs: Failed to create inode cache\n");
+        return -ENOMEM;
+    }
+    
+    ret = register_filesystem(&example_fs_type);
+    if (ret) {
         pr_err("example_vfs: Failed to register filesystem\n");
-    else
+        kmem_cache_destroy(example_inode_cachep);
+    } else {
         pr_info("example_vfs: Filesystem registered\n");
+    }
     
     return ret;
 }
@@ -313,6 +2520,10 @@ static int __init example_vfs_init(void)
 static void __exit example_vfs_exit(void)
 {
     unregister_filesystem(&example_fs_type);
+    
+    // Wait for example_free_inode() callbacks before destroying the cache
+    rcu_barrier();
+    kmem_cache_destroy(example_inode_cachep);
     pr_info("example_vfs: Filesystem unregistered\n");
 }
 
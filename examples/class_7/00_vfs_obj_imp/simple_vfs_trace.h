@@ -0,0 +1,131 @@
+// Tracepoints for the example_vfs hot paths
+//
+// Enable with:
+//   echo 1 > /sys/kernel/tracing/events/example_vfs/enable
+//   cat /sys/kernel/tracing/trace_pipe
+//
+// Every event carries the time the operation took.  The start time is only
+// sampled while the event is enabled (see example_trace_start()), so a
+// disabled event costs one patched-out branch.
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM example_vfs
+
+#if !defined(_SIMPLE_VFS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _SIMPLE_VFS_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/timekeeping.h>
+#include <linux/fs.h>
+
+TRACE_EVENT(example_vfs_open,
+    TP_PROTO(struct inode *inode, struct file *file, int ret, u64 start),
+    TP_ARGS(inode, file, ret, start),
+
+    TP_STRUCT__entry(
+        __field(dev_t, dev)
+        __field(unsigned long, ino)
+        __field(unsigned int, flags)
+        __field(int, ret)
+        __field(u64, latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->dev = inode->i_sb->s_dev;
+        __entry->ino = inode->i_ino;
+        __entry->flags = file->f_flags;
+        __entry->ret = ret;
+        __entry->latency_ns = ktime_get_ns() - start;
+    ),
+
+    TP_printk("dev %d:%d ino %lu flags 0x%x ret %d latency %llu ns",
+              MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+              __entry->flags, __entry->ret, __entry->latency_ns)
+);
+
+DECLARE_EVENT_CLASS(example_vfs_io,
+    TP_PROTO(struct inode *inode, loff_t pos, size_t count, ssize_t ret, u64 start),
+    TP_ARGS(inode, pos, count, ret, start),
+
+    TP_STRUCT__entry(
+        __field(dev_t, dev)
+        __field(unsigned long, ino)
+        __field(loff_t, pos)
+        __field(size_t, count)
+        __field(ssize_t, ret)
+        __field(u64, latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->dev = inode->i_sb->s_dev;
+        __entry->ino = inode->i_ino;
+        __entry->pos = pos;
+        __entry->count = count;
+        __entry->ret = ret;
+        __entry->latency_ns = ktime_get_ns() - start;
+    ),
+
+    TP_printk("dev %d:%d ino %lu pos %lld count %zu ret %zd latency %llu ns",
+              MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+              __entry->pos, __entry->count, __entry->ret, __entry->latency_ns)
+);
+
+DEFINE_EVENT(example_vfs_io, example_vfs_read,
+    TP_PROTO(struct inode *inode, loff_t pos, size_t count, ssize_t ret, u64 start),
+    TP_ARGS(inode, pos, count, ret, start)
+);
+
+DEFINE_EVENT(example_vfs_io, example_vfs_write,
+    TP_PROTO(struct inode *inode, loff_t pos, size_t count, ssize_t ret, u64 start),
+    TP_ARGS(inode, pos, count, ret, start)
+);
+
+DECLARE_EVENT_CLASS(example_vfs_dentry,
+    TP_PROTO(struct inode *dir, struct dentry *dentry, int ret, u64 start),
+    TP_ARGS(dir, dentry, ret, start),
+
+    TP_STRUCT__entry(
+        __field(dev_t, dev)
+        __field(unsigned long, dir)
+        __field(unsigned long, ino)
+        __field(int, ret)
+        __field(u64, latency_ns)
+        __string(name, dentry->d_name.name)
+    ),
+
+    TP_fast_assign(
+        __entry->dev = dir->i_sb->s_dev;
+        __entry->dir = dir->i_ino;
+        __entry->ino = d_really_is_positive(dentry) ? d_inode(dentry)->i_ino : 0;
+        __entry->ret = ret;
+        __entry->latency_ns = ktime_get_ns() - start;
+        __assign_str(name, dentry->d_name.name);
+    ),
+
+    TP_printk("dev %d:%d dir %lu name %s ino %lu ret %d latency %llu ns",
+              MAJOR(__entry->dev), MINOR(__entry->dev), __entry->dir,
+              __get_str(name), __entry->ino, __entry->ret, __entry->latency_ns)
+);
+
+DEFINE_EVENT(example_vfs_dentry, example_vfs_lookup,
+    TP_PROTO(struct inode *dir, struct dentry *dentry, int ret, u64 start),
+    TP_ARGS(dir, dentry, ret, start)
+);
+
+DEFINE_EVENT(example_vfs_dentry, example_vfs_create,
+    TP_PROTO(struct inode *dir, struct dentry *dentry, int ret, u64 start),
+    TP_ARGS(dir, dentry, ret, start)
+);
+
+DEFINE_EVENT(example_vfs_dentry, example_vfs_unlink,
+    TP_PROTO(struct inode *dir, struct dentry *dentry, int ret, u64 start),
+    TP_ARGS(dir, dentry, ret, start)
+);
+
+#endif /* _SIMPLE_VFS_TRACE_H */
+
+// This part must be outside the include guard
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE simple_vfs_trace
+#include <trace/define_trace.h>
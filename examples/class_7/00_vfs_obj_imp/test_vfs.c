@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,10 +6,73 @@
 #include <string.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/xattr.h>
+#include <sys/ioctl.h>
+#include <stdint.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
 #include <errno.h>
 
 #define MOUNT_POINT "/mnt/example_vfs"
 #define TEST_FILE "/mnt/example_vfs/testfile"
+#define LIMIT_MOUNT_POINT "/mnt/example_vfs_limited"
+#define LIMIT_NR_INODES 4
+#define BULK_FILES 64
+#define DCACHE_MOUNT_POINT "/mnt/example_vfs_dcache"
+#define DCACHE_NEG_LIMIT 16
+#define DCACHE_PROBES 100
+#define IMPORT_MOUNT_POINT "/mnt/example_vfs_import"
+#define ARCHIVE_FILE "/tmp/example_vfs.cpio"
+#define ARCHIVE_BIG (3 * 4096 + 17)
+#define HUGE_MOUNT_POINT "/mnt/example_vfs_huge"
+#define HUGE_PMD_SIZE (2UL << 20)
+#define CHURN_MOUNT_POINT "/mnt/example_vfs_churn"
+#define CHURN_ROUNDS 10
+#define CHURN_FILES 1000
+#define CHURN_SIZE (2 * INLINE_MAX)
+#define COPY_SIZE (256 * 1024 + 123)
+#define SPARSE_PAGE 4096
+#define INLINE_MAX 128
+#define STRESS_FILE "/mnt/example_vfs/stress"
+#define STRESS_RECORD 64
+#define STRESS_RECORDS 16384
+#define STRESS_MAX_READERS 8
+
+// IOCTL command definitions (must match simple_vfs.c)
+#define EXAMPLE_VFS_IOC_MAGIC 'E'
+
+struct example_bulk_create {
+    uint32_t count;
+    uint32_t mode;
+    uint64_t names;
+    uint64_t names_len;
+    uint64_t inos;
+};
+
+#define EXAMPLE_VFS_IOC_BULK_CREATE _IOWR(EXAMPLE_VFS_IOC_MAGIC, 1, struct example_bulk_create)
+
+struct example_dcache_stats {
+    uint64_t lookups;
+    uint64_t negative;
+    uint64_t negative_limit;
+    uint64_t negative_dropped;
+    uint64_t negative_reused;
+};
+
+#define EXAMPLE_VFS_IOC_DCACHE_STATS _IOR(EXAMPLE_VFS_IOC_MAGIC, 2, struct example_dcache_stats)
+
+struct example_export {
+    int32_t fd;
+    uint32_t flags;
+    uint64_t bytes;
+};
+
+#define EXAMPLE_VFS_IOC_EXPORT _IOWR(EXAMPLE_VFS_IOC_MAGIC, 3, struct example_export)
 
 // Helper function to create directory recursively
 int create_dir_recursive(const char *path, mode_t mode)
@@ -39,6 +103,950 @@ out:
     return ret;
 }
 
+// Mount a second instance with nr_inodes= and check creation stops at the limit
+int test_mount_limits(void)
+{
+    char path[256];
+    struct statfs sfs;
+    struct stat root, other;
+    int i, fd, created = 0;
+    
+    printf("\nTesting mount limits (nr_inodes=%d):\n", LIMIT_NR_INODES);
+    
+    if (mkdir(LIMIT_MOUNT_POINT, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir");
+        return -1;
+    }
+    
+    if (mount("none", LIMIT_MOUNT_POINT, "example_vfs", 0, "bogus=1") == 0 || errno != EINVAL) {
+        printf("Unknown mount option was not rejected\n");
+        umount(LIMIT_MOUNT_POINT);
+        return -1;
+    }
+    
+    if (mount("none", LIMIT_MOUNT_POINT, "example_vfs", 0, "size=1m,nr_inodes=4") < 0) {
+        perror("mount");
+        return -1;
+    }
+    
+    // Inode numbers are per mount: both roots were the first inode of theirs
+    if (stat(MOUNT_POINT, &root) < 0 || stat(LIMIT_MOUNT_POINT, &other) < 0 ||
+        root.st_ino != 1 || other.st_ino != 1) {
+        printf("Root inode numbers %lu and %lu, expected 1 and 1\n",
+               (unsigned long)root.st_ino, (unsigned long)other.st_ino);
+        umount(LIMIT_MOUNT_POINT);
+        return -1;
+    }
+    
+    // The root directory already uses one inode
+    for (i = 0; i < LIMIT_NR_INODES + 2; i++) {
+        snprintf(path, sizeof(path), "%s/limit_%d", LIMIT_MOUNT_POINT, i);
+        fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            printf("Create %d failed: %s\n", i, strerror(errno));
+            break;
+        }
+        close(fd);
+        created++;
+    }
+    printf("Created %d files before hitting the limit\n", created);
+    
+    if (statfs(LIMIT_MOUNT_POINT, &sfs) == 0)
+        printf("statfs: blocks=%ld free=%ld files=%ld ffree=%ld\n",
+               (long)sfs.f_blocks, (long)sfs.f_bfree,
+               (long)sfs.f_files, (long)sfs.f_ffree);
+    
+    umount(LIMIT_MOUNT_POINT);
+    return created == LIMIT_NR_INODES - 1 ? 0 : -1;
+}
+
+// Set a small (inline) and a large xattr, then read and list them back
+int test_xattrs(const char *path)
+{
+    char big[256], buf[256], list[256];
+    ssize_t len, off;
+    
+    printf("\nTesting extended attributes:\n");
+    
+    memset(big, 'x', sizeof(big));
+    if (setxattr(path, "user.small", "v1", 2, 0) < 0 ||
+        setxattr(path, "user.large", big, sizeof(big), 0) < 0) {
+        perror("setxattr");
+        return -1;
+    }
+    
+    len = getxattr(path, "user.small", buf, sizeof(buf));
+    if (len != 2 || memcmp(buf, "v1", 2)) {
+        printf("getxattr user.small returned %zd\n", len);
+        return -1;
+    }
+    
+    len = getxattr(path, "user.large", buf, sizeof(buf));
+    if (len != sizeof(big) || memcmp(buf, big, sizeof(big))) {
+        printf("getxattr user.large returned %zd\n", len);
+        return -1;
+    }
+    
+    if (setxattr(path, "user.small", "v2", 2, XATTR_CREATE) == 0 || errno != EEXIST) {
+        printf("XATTR_CREATE on an existing name did not fail with EEXIST\n");
+        return -1;
+    }
+    
+    len = listxattr(path, list, sizeof(list));
+    if (len < 0) {
+        perror("listxattr");
+        return -1;
+    }
+    for (off = 0; off < len; off += strlen(list + off) + 1)
+        printf("  %s\n", list + off);
+    
+    if (removexattr(path, "user.large") < 0) {
+        perror("removexattr");
+        return -1;
+    }
+    
+    printf("Extended attributes OK\n");
+    return 0;
+}
+
+// Create BULK_FILES files with one ioctl on the mount root
+int test_bulk_create(void)
+{
+    char names[BULK_FILES * 16];
+    uint64_t inos[BULK_FILES];
+    struct example_bulk_create req;
+    char path[256];
+    struct stat st;
+    size_t len = 0;
+    int i, dirfd, ret;
+    
+    printf("\nTesting bulk create (%d files):\n", BULK_FILES);
+    
+    for (i = 0; i < BULK_FILES; i++)
+        len += sprintf(names + len, "bulk_%d", i) + 1;
+    
+    dirfd = open(MOUNT_POINT, O_RDONLY | O_DIRECTORY);
+    if (dirfd < 0) {
+        perror("open dir");
+        return -1;
+    }
+    
+    memset(&req, 0, sizeof(req));
+    req.count = BULK_FILES;
+    req.mode = 0644;
+    req.names = (uintptr_t)names;
+    req.names_len = len;
+    req.inos = (uintptr_t)inos;
+    
+    ret = ioctl(dirfd, EXAMPLE_VFS_IOC_BULK_CREATE, &req);
+    close(dirfd);
+    if (ret < 0) {
+        perror("EXAMPLE_VFS_IOC_BULK_CREATE");
+        printf("Created %u of %d files\n", req.count, BULK_FILES);
+        return -1;
+    }
+    
+    // Spot-check that the returned inode numbers match what stat sees
+    snprintf(path, sizeof(path), "%s/bulk_%d", MOUNT_POINT, BULK_FILES - 1);
+    if (stat(path, &st) < 0 || st.st_ino != inos[BULK_FILES - 1]) {
+        printf("Inode number mismatch for %s\n", path);
+        return -1;
+    }
+    
+    printf("Created %u files, first inode %llu, last inode %llu\n", req.count,
+           (unsigned long long)inos[0], (unsigned long long)inos[BULK_FILES - 1]);
+    return 0;
+}
+
+// Active objects in the example_vfs inode slab, or -1 if unavailable
+long inode_slab_objects(void)
+{
+    char line[512], name[64];
+    long active = -1;
+    FILE *f = fopen("/proc/slabinfo", "r");
+    
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%63s %ld", name, &active) == 2 &&
+            strcmp(name, "example_inode_cache") == 0)
+            break;
+        active = -1;
+    }
+    fclose(f);
+    return active;
+}
+
+// Repeated create/write/unlink must not grow inode or block usage
+int test_churn(void)
+{
+    char path[256], data[CHURN_SIZE];
+    struct statfs before, after;
+    int round, i, fd, ret = -1;
+    
+    printf("\nTesting create/write/unlink churn (%d x %d files):\n",
+           CHURN_ROUNDS, CHURN_FILES);
+    
+    if (mkdir(CHURN_MOUNT_POINT, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir");
+        return -1;
+    }
+    
+    // Limits make statfs report usage
+    if (mount("none", CHURN_MOUNT_POINT, "example_vfs", 0, "size=64m,nr_inodes=1000000") < 0) {
+        perror("mount");
+        return -1;
+    }
+    
+    // Too big to stay inline, so every file charges a block
+    memset(data, 'c', sizeof(data));
+    statfs(CHURN_MOUNT_POINT, &before);
+    printf("Start:    used inodes %ld, used blocks %ld, inode slab objects %ld\n",
+           (long)(before.f_files - before.f_ffree), (long)(before.f_blocks - before.f_bfree),
+           inode_slab_objects());
+    
+    for (round = 0; round < CHURN_ROUNDS; round++) {
+        for (i = 0; i < CHURN_FILES; i++) {
+            snprintf(path, sizeof(path), "%s/churn_%d", CHURN_MOUNT_POINT, i);
+            fd = open(path, O_RDWR | O_CREAT, 0644);
+            if (fd < 0) {
+                perror("open");
+                goto out;
+            }
+            if (write(fd, data, sizeof(data)) < 0)
+                perror("write");
+            close(fd);
+        }
+        for (i = 0; i < CHURN_FILES; i++) {
+            snprintf(path, sizeof(path), "%s/churn_%d", CHURN_MOUNT_POINT, i);
+            unlink(path);
+        }
+        
+        statfs(CHURN_MOUNT_POINT, &after);
+        printf("Round %2d: used inodes %ld, used blocks %ld, inode slab objects %ld\n", round,
+               (long)(after.f_files - after.f_ffree), (long)(after.f_blocks - after.f_bfree),
+               inode_slab_objects());
+    }
+    
+    ret = after.f_ffree == before.f_ffree && after.f_bfree == before.f_bfree ? 0 : -1;
+    
+out:
+    umount(CHURN_MOUNT_POINT);
+    return ret;
+}
+
+// Read the dentry cache counters of the DCACHE_MOUNT_POINT mount
+int dcache_stats(struct example_dcache_stats *st)
+{
+    int fd = open(DCACHE_MOUNT_POINT, O_RDONLY | O_DIRECTORY);
+    int ret;
+    
+    if (fd < 0)
+        return -1;
+    ret = ioctl(fd, EXAMPLE_VFS_IOC_DCACHE_STATS, st);
+    close(fd);
+    return ret;
+}
+
+int test_dcache(void)
+{
+    struct example_dcache_stats st, after;
+    struct example_bulk_create req;
+    char path[256], names[2 * DCACHE_NEG_LIMIT * 16];
+    uint64_t inos[2 * DCACHE_NEG_LIMIT];
+    struct stat sb;
+    size_t len = 0;
+    int i, fd, ret = -1;
+    
+    printf("\nTesting negative dentries (nr_negative=%d) and casefold:\n", DCACHE_NEG_LIMIT);
+    
+    if (mkdir(DCACHE_MOUNT_POINT, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir");
+        return -1;
+    }
+    
+    if (mount("none", DCACHE_MOUNT_POINT, "example_vfs", 0, "nr_negative=16,casefold") < 0) {
+        perror("mount");
+        return -1;
+    }
+    
+    // Probe missing names twice: the second pass only misses the dcache
+    // for names that did not fit under the limit
+    for (i = 0; i < 2 * DCACHE_PROBES; i++) {
+        snprintf(path, sizeof(path), "%s/missing_%d.h", DCACHE_MOUNT_POINT, i % DCACHE_PROBES);
+        if (stat(path, &sb) == 0 || errno != ENOENT) {
+            printf("stat %s did not fail with ENOENT\n", path);
+            goto out;
+        }
+    }
+    
+    if (dcache_stats(&st) < 0) {
+        perror("ioctl(DCACHE_STATS)");
+        goto out;
+    }
+    printf("lookups %lu negative %lu/%lu dropped %lu\n",
+           (unsigned long)st.lookups, (unsigned long)st.negative,
+           (unsigned long)st.negative_limit, (unsigned long)st.negative_dropped);
+    if (st.negative > DCACHE_NEG_LIMIT || !st.negative_dropped ||
+        st.lookups >= 2 * DCACHE_PROBES) {
+        printf("negative dentries not bounded or not cached\n");
+        goto out;
+    }
+    
+    // Creating over a cached negative hands its slot back
+    snprintf(path, sizeof(path), "%s/missing_0.h", DCACHE_MOUNT_POINT);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("open");
+        goto out;
+    }
+    close(fd);
+    
+    // Names are case-insensitive on a casefold mount
+    snprintf(path, sizeof(path), "%s/MISSING_0.H", DCACHE_MOUNT_POINT);
+    if (stat(path, &sb) < 0) {
+        printf("casefold lookup of %s failed: %s\n", path, strerror(errno));
+        goto out;
+    }
+    
+    // Bulk create looks up names it is about to create: that must neither
+    // take negative slots nor count as reusing them, even past the limit
+    for (i = 0; i < 2 * DCACHE_NEG_LIMIT; i++)
+        len += sprintf(names + len, "bulk_%d", i) + 1;
+    memset(&req, 0, sizeof(req));
+    req.count = 2 * DCACHE_NEG_LIMIT;
+    req.mode = 0644;
+    req.names = (uintptr_t)names;
+    req.names_len = len;
+    req.inos = (uintptr_t)inos;
+    
+    fd = open(DCACHE_MOUNT_POINT, O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || dcache_stats(&st) < 0 || ioctl(fd, EXAMPLE_VFS_IOC_BULK_CREATE, &req) < 0 ||
+        dcache_stats(&after) < 0) {
+        perror("bulk create");
+        if (fd >= 0)
+            close(fd);
+        goto out;
+    }
+    close(fd);
+    printf("bulk create: reused %lu -> %lu, dropped %lu -> %lu\n",
+           (unsigned long)st.negative_reused, (unsigned long)after.negative_reused,
+           (unsigned long)st.negative_dropped, (unsigned long)after.negative_dropped);
+    if (after.negative_reused != st.negative_reused ||
+        after.negative_dropped != st.negative_dropped) {
+        printf("bulk create went through negative dentry slots\n");
+        goto out;
+    }
+    
+    ret = 0;
+    printf("Negative dentry cache OK\n");
+    
+out:
+    umount(DCACHE_MOUNT_POINT);
+    return ret;
+}
+
+// Compare two files byte for byte; returns 0 when they match
+int compare_files(const char *a, const char *b)
+{
+    char buf_a[4096], buf_b[4096];
+    int fa = open(a, O_RDONLY), fb = open(b, O_RDONLY);
+    ssize_t na, nb;
+    int ret = -1;
+    
+    if (fa < 0 || fb < 0)
+        goto out;
+    
+    do {
+        na = read(fa, buf_a, sizeof(buf_a));
+        nb = read(fb, buf_b, sizeof(buf_b));
+        if (na != nb || (na > 0 && memcmp(buf_a, buf_b, na)))
+            goto out;
+    } while (na > 0);
+    ret = na == 0 ? 0 : -1;
+    
+out:
+    if (fa >= 0)
+        close(fa);
+    if (fb >= 0)
+        close(fb);
+    return ret;
+}
+
+// Export the mount to a cpio archive and mount a new instance from it
+int test_archive(void)
+{
+    const char *names[] = { "archive_small", "archive_big" };
+    struct example_export req = { 0 };
+    char src[256], dst[256], buf[ARCHIVE_BIG];
+    int i, fd, dir, ret = -1;
+    
+    printf("\nTesting cpio export and import:\n");
+    
+    // One inline file and one that spans pages with a partial tail
+    memset(buf, 'a', sizeof(buf));
+    for (i = 0; i < 2; i++) {
+        snprintf(src, sizeof(src), "%s/%s", MOUNT_POINT, names[i]);
+        fd = open(src, O_WRONLY | O_CREAT | O_TRUNC, 0640);
+        if (fd < 0 || write(fd, buf, i ? ARCHIVE_BIG : 42) < 0) {
+            perror("write");
+            if (fd >= 0)
+                close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    
+    dir = open(MOUNT_POINT, O_RDONLY | O_DIRECTORY);
+    req.fd = open(ARCHIVE_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (dir < 0 || req.fd < 0) {
+        perror("open");
+        goto out;
+    }
+    if (ioctl(dir, EXAMPLE_VFS_IOC_EXPORT, &req) < 0) {
+        perror("ioctl(EXPORT)");
+        goto out;
+    }
+    printf("Exported %lu bytes to %s\n", (unsigned long)req.bytes, ARCHIVE_FILE);
+    
+    if (mkdir(IMPORT_MOUNT_POINT, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir");
+        goto out;
+    }
+    if (mount("none", IMPORT_MOUNT_POINT, "example_vfs", 0, "import=" ARCHIVE_FILE) < 0) {
+        perror("mount(import)");
+        goto out;
+    }
+    
+    ret = 0;
+    for (i = 0; i < 2; i++) {
+        snprintf(src, sizeof(src), "%s/%s", MOUNT_POINT, names[i]);
+        snprintf(dst, sizeof(dst), "%s/%s", IMPORT_MOUNT_POINT, names[i]);
+        if (compare_files(src, dst) < 0) {
+            printf("%s did not survive export/import\n", names[i]);
+            ret = -1;
+        }
+    }
+    umount(IMPORT_MOUNT_POINT);
+    
+    if (!ret)
+        printf("cpio round trip OK\n");
+    
+out:
+    if (req.fd >= 0)
+        close(req.fd);
+    if (dir >= 0)
+        close(dir);
+    unlink(ARCHIVE_FILE);
+    return ret;
+}
+
+// copy_file_range() and sendfile() between example_vfs files stay in the kernel
+int test_copy_paths(void)
+{
+    const char *src = MOUNT_POINT "/copy_src";
+    const char *dst = MOUNT_POINT "/copy_dst";
+    const char *dst2 = MOUNT_POINT "/sendfile_dst";
+    char buf[4096];
+    ssize_t n, total;
+    int i, in, out;
+    
+    printf("\nTesting copy_file_range and sendfile (%d bytes):\n", COPY_SIZE);
+    
+    out = open(src, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        perror("open src");
+        return -1;
+    }
+    for (total = 0; total < COPY_SIZE; total += n) {
+        for (i = 0; i < (int)sizeof(buf); i++)
+            buf[i] = (char)(total + i);
+        n = write(out, buf, COPY_SIZE - total < (ssize_t)sizeof(buf) ?
+                            COPY_SIZE - total : (ssize_t)sizeof(buf));
+        if (n <= 0) {
+            perror("write src");
+            close(out);
+            return -1;
+        }
+    }
+    close(out);
+    
+    in = open(src, O_RDONLY);
+    out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (total = 0; total < COPY_SIZE; total += n) {
+        n = copy_file_range(in, NULL, out, NULL, COPY_SIZE - total, 0);
+        if (n <= 0) {
+            perror("copy_file_range");
+            break;
+        }
+    }
+    close(out);
+    
+    lseek(in, 0, SEEK_SET);
+    out = open(dst2, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    for (total = 0; total < COPY_SIZE; total += n) {
+        n = sendfile(out, in, NULL, COPY_SIZE - total);
+        if (n <= 0) {
+            perror("sendfile");
+            break;
+        }
+    }
+    close(out);
+    close(in);
+    
+    if (compare_files(src, dst) < 0 || compare_files(src, dst2) < 0) {
+        printf("Copied data does not match the source\n");
+        return -1;
+    }
+    
+    printf("copy_file_range and sendfile copies match\n");
+    return 0;
+}
+
+// writev/readv plus a RWF_NOWAIT read that must not return EAGAIN
+int test_vectored_io(void)
+{
+    const char *path = MOUNT_POINT "/vectored";
+    char a[] = "vectored ", b[] = "write", out_a[9], out_b[5], sparse[16];
+    struct iovec wv[2] = { { a, 9 }, { b, 5 } };
+    struct iovec rv[2] = { { out_a, 9 }, { out_b, 5 } };
+    struct iovec hv = { sparse, sizeof(sparse) };
+    ssize_t n;
+    int fd;
+    
+    printf("\nTesting vectored and RWF_NOWAIT I/O:\n");
+    
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    
+    n = writev(fd, wv, 2);
+    if (n != 14) {
+        perror("writev");
+        goto fail;
+    }
+    
+    n = preadv2(fd, rv, 2, 0, RWF_NOWAIT);
+    if (n != 14 || memcmp(out_a, a, 9) || memcmp(out_b, b, 5)) {
+        printf("preadv2(RWF_NOWAIT) returned %zd: %s\n", n, n < 0 ? strerror(errno) : "short");
+        goto fail;
+    }
+    
+    // A hole is read back as zeroes without blocking either
+    if (ftruncate(fd, 1 << 20) < 0) {
+        perror("ftruncate");
+        goto fail;
+    }
+    n = preadv2(fd, &hv, 1, 512 * 1024, RWF_NOWAIT);
+    if (n != sizeof(sparse) || sparse[0] || sparse[sizeof(sparse) - 1]) {
+        printf("preadv2(RWF_NOWAIT) on a hole returned %zd\n", n);
+        goto fail;
+    }
+    
+    close(fd);
+    printf("Vectored and RWF_NOWAIT I/O OK\n");
+    return 0;
+    
+fail:
+    close(fd);
+    return -1;
+}
+
+// One appender, N readers: readers must never see a record that is only
+// partly written, and their aggregate rate should grow with N
+struct stress_state {
+    volatile int stop;
+    long reads;
+    long torn;
+};
+
+void *stress_reader(void *arg)
+{
+    struct stress_state *st = arg;
+    char buf[STRESS_RECORD];
+    struct stat sb;
+    long reads = 0, torn = 0;
+    off_t off;
+    int i, fd = open(STRESS_FILE, O_RDONLY);
+    
+    if (fd < 0)
+        return NULL;
+    
+    while (!st->stop) {
+        if (fstat(fd, &sb) < 0)
+            break;
+        // Check the last complete record the size says is there
+        off = (sb.st_size / STRESS_RECORD - 1) * STRESS_RECORD;
+        if (off < 0)
+            continue;
+        if (pread(fd, buf, STRESS_RECORD, off) != STRESS_RECORD) {
+            torn++;
+            continue;
+        }
+        for (i = 1; i < STRESS_RECORD; i++)
+            if (buf[i] != buf[0])
+                break;
+        if (i != STRESS_RECORD || buf[0] != (char)(off / STRESS_RECORD))
+            torn++;
+        reads++;
+    }
+    
+    close(fd);
+    __sync_fetch_and_add(&st->reads, reads);
+    __sync_fetch_and_add(&st->torn, torn);
+    return NULL;
+}
+
+int test_concurrent_readers(void)
+{
+    pthread_t readers[STRESS_MAX_READERS];
+    struct stress_state st;
+    struct timespec t0, t1;
+    char record[STRESS_RECORD];
+    int nr, i, fd, ret = 0;
+    double secs;
+    
+    printf("\nTesting concurrent readers with one appending writer:\n");
+    
+    for (nr = 1; nr <= STRESS_MAX_READERS; nr *= 2) {
+        memset(&st, 0, sizeof(st));
+        
+        fd = open(STRESS_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (fd < 0) {
+            perror("open");
+            return -1;
+        }
+        
+        for (i = 0; i < nr; i++)
+            pthread_create(&readers[i], NULL, stress_reader, &st);
+        
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (i = 0; i < STRESS_RECORDS; i++) {
+            memset(record, (char)i, sizeof(record));
+            if (write(fd, record, sizeof(record)) != sizeof(record)) {
+                perror("write");
+                break;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        
+        st.stop = 1;
+        for (i = 0; i < nr; i++)
+            pthread_join(readers[i], NULL);
+        close(fd);
+        
+        secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+        printf("%d reader(s): %.0f reads/s, %ld torn records\n", nr, st.reads / secs, st.torn);
+        if (st.torn)
+            ret = -1;
+    }
+    
+    unlink(STRESS_FILE);
+    return ret;
+}
+
+int test_inline(void)
+{
+    const char *path = MOUNT_POINT "/inline";
+    char data[INLINE_MAX], big[2 * SPARSE_PAGE], check[2 * SPARSE_PAGE];
+    struct stat st;
+    int fd;
+    
+    printf("\nTesting inline small files:\n");
+    
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    
+    // A file that fits inline takes no blocks
+    memset(data, 'i', sizeof(data));
+    if (pwrite(fd, data, 100, 0) != 100 || fstat(fd, &st) < 0) {
+        perror("write");
+        goto fail;
+    }
+    if (st.st_size != 100 || st.st_blocks != 0) {
+        printf("inline file: size %ld, %ld blocks\n", (long)st.st_size, (long)st.st_blocks);
+        goto fail;
+    }
+    
+    // Growing inline zeroes the gap
+    if (ftruncate(fd, INLINE_MAX) < 0 ||
+        pread(fd, check, INLINE_MAX, 0) != INLINE_MAX ||
+        memcmp(check, data, 100) || check[100] || check[INLINE_MAX - 1]) {
+        printf("inline truncate lost data\n");
+        goto fail;
+    }
+    
+    // Writing past the threshold moves the file into pages, contents intact
+    memset(big, 'p', sizeof(big));
+    memcpy(big, data, 100);
+    memset(big + 100, 0, INLINE_MAX - 100);
+    if (pwrite(fd, big + INLINE_MAX, sizeof(big) - INLINE_MAX, INLINE_MAX) !=
+        (ssize_t)(sizeof(big) - INLINE_MAX) || fstat(fd, &st) < 0) {
+        perror("write");
+        goto fail;
+    }
+    if (st.st_size != sizeof(big) || st.st_blocks == 0 ||
+        pread(fd, check, sizeof(check), 0) != sizeof(check) ||
+        memcmp(check, big, sizeof(big))) {
+        printf("migration to pages: size %ld, %ld blocks\n", (long)st.st_size, (long)st.st_blocks);
+        goto fail;
+    }
+    printf("Migrated to pages at %ld bytes, %ld blocks\n", (long)st.st_size, (long)st.st_blocks);
+    
+    close(fd);
+    unlink(path);
+    printf("Inline small files OK\n");
+    return 0;
+    
+fail:
+    close(fd);
+    unlink(path);
+    return -1;
+}
+
+int test_mmap(void)
+{
+    const char *path = MOUNT_POINT "/mapped";
+    char small[] = "inline data seen through a mapping", check[sizeof(small)];
+    char *map;
+    int fd;
+    
+    printf("\nTesting mmap:\n");
+    
+    // An inline file moves to the page cache on its first fault
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, small, sizeof(small)) != sizeof(small)) {
+        perror("write");
+        goto out;
+    }
+    map = mmap(NULL, sizeof(small), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        goto out;
+    }
+    if (memcmp(map, small, sizeof(small))) {
+        printf("mapping does not show the inline data\n");
+        munmap(map, sizeof(small));
+        goto out;
+    }
+    
+    // Stores through the mapping are what read() returns
+    map[0] = 'I';
+    munmap(map, sizeof(small));
+    if (pread(fd, check, sizeof(check), 0) != sizeof(check) || check[0] != 'I' ||
+        memcmp(check + 1, small + 1, sizeof(small) - 1)) {
+        printf("read() after a store through the mapping saw stale data\n");
+        goto out;
+    }
+    close(fd);
+    unlink(path);
+    
+    printf("mmap OK\n");
+    return 0;
+    
+out:
+    if (fd >= 0)
+        close(fd);
+    unlink(path);
+    return -1;
+}
+
+// True if the kernel has THP and it is not switched off
+int thp_enabled(void)
+{
+    char mode[128] = "";
+    FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    
+    if (!f)
+        return 0;
+    if (!fgets(mode, sizeof(mode), f))
+        mode[0] = '\0';
+    fclose(f);
+    return mode[0] && !strstr(mode, "[never]");
+}
+
+// @field ("FilePmdMapped:" etc.) of the mapping starting at @addr in
+// /proc/self/smaps, in kB, or -1 if it is not there
+long smaps_field_kb(void *addr, const char *field)
+{
+    char line[512], perms[8];
+    unsigned long start, end;
+    int in_vma = 0;
+    long kb = -1;
+    FILE *f = fopen("/proc/self/smaps", "r");
+    
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%lx-%lx %7s", &start, &end, perms) == 3)
+            in_vma = start == (unsigned long)addr;
+        else if (in_vma && !strncmp(line, field, strlen(field)))
+            kb = atol(line + strlen(field));
+    }
+    fclose(f);
+    return kb;
+}
+
+// huge=always: a file written with write() and a hole faulted in through
+// a mapping are both cached in PMD folios and mapped with one PMD each
+int test_huge(void)
+{
+    const char *path = HUGE_MOUNT_POINT "/mapped";
+    char buf[64 * 1024];
+    int fd, thp = thp_enabled(), ret = -1;
+    size_t off;
+    long pmd_kb;
+    char *map;
+    
+    printf("\nTesting huge=always:\n");
+    
+    if (mkdir(HUGE_MOUNT_POINT, 0755) < 0 && errno != EEXIST) {
+        perror("mkdir");
+        return -1;
+    }
+    if (mount("none", HUGE_MOUNT_POINT, "example_vfs", 0, "huge=always") < 0) {
+        perror("mount(huge=always)");
+        return -1;
+    }
+    
+    // First PMD written, second one a hole
+    memset(buf, 'h', sizeof(buf));
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("open");
+        goto out;
+    }
+    for (off = 0; off < HUGE_PMD_SIZE; off += sizeof(buf)) {
+        if (write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+            perror("write");
+            goto out;
+        }
+    }
+    if (ftruncate(fd, 2 * HUGE_PMD_SIZE) < 0) {
+        perror("ftruncate");
+        goto out;
+    }
+    
+    map = mmap(NULL, 2 * HUGE_PMD_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        goto out;
+    }
+    if (map[0] != 'h' || map[HUGE_PMD_SIZE - 1] != 'h' ||
+        map[HUGE_PMD_SIZE] || map[2 * HUGE_PMD_SIZE - 1]) {
+        printf("mapping does not show the written data and the hole\n");
+        goto out_unmap;
+    }
+    
+    pmd_kb = smaps_field_kb(map, "FilePmdMapped:");
+    printf("mapping at %p, FilePmdMapped %ld kB%s\n", map, pmd_kb,
+           thp ? "" : " (THP off, not checked)");
+    if (thp && (((uintptr_t)map & (HUGE_PMD_SIZE - 1)) ||
+                pmd_kb < (long)(2 * HUGE_PMD_SIZE >> 10))) {
+        printf("file is not mapped with PMDs\n");
+        goto out_unmap;
+    }
+    
+    ret = 0;
+    printf("huge=always OK\n");
+    
+out_unmap:
+    munmap(map, 2 * HUGE_PMD_SIZE);
+out:
+    if (fd >= 0)
+        close(fd);
+    unlink(path);
+    umount(HUGE_MOUNT_POINT);
+    return ret;
+}
+
+int test_sparse(void)
+{
+    const char *path = MOUNT_POINT "/sparse";
+    char page[SPARSE_PAGE], check[SPARSE_PAGE];
+    struct stat before, after;
+    off_t off;
+    int fd;
+    
+    printf("\nTesting fallocate and SEEK_DATA/SEEK_HOLE:\n");
+    
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    
+    // Two data pages separated by a hole: [0, 4k) and [512k, 516k)
+    memset(page, 'S', sizeof(page));
+    if (pwrite(fd, page, sizeof(page), 0) != sizeof(page) ||
+        pwrite(fd, page, sizeof(page), 512 * 1024) != sizeof(page) ||
+        ftruncate(fd, 1 << 20) < 0) {
+        perror("write");
+        goto fail;
+    }
+    
+    if (lseek(fd, 0, SEEK_HOLE) != SPARSE_PAGE ||
+        lseek(fd, SPARSE_PAGE, SEEK_DATA) != 512 * 1024 ||
+        lseek(fd, 512 * 1024, SEEK_HOLE) != 512 * 1024 + SPARSE_PAGE) {
+        printf("SEEK_DATA/SEEK_HOLE did not find the layout\n");
+        goto fail;
+    }
+    
+    // Punching the second page leaves nothing but the first one
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 512 * 1024, SPARSE_PAGE) < 0) {
+        perror("fallocate(PUNCH_HOLE)");
+        goto fail;
+    }
+    off = lseek(fd, SPARSE_PAGE, SEEK_DATA);
+    if (off != -1 || errno != ENXIO) {
+        printf("SEEK_DATA after punch returned %ld\n", (long)off);
+        goto fail;
+    }
+    
+    // Zeroing keeps the range allocated
+    if (fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, SPARSE_PAGE) < 0 ||
+        pread(fd, check, sizeof(check), 0) != sizeof(check)) {
+        perror("fallocate(ZERO_RANGE)");
+        goto fail;
+    }
+    memset(page, 0, sizeof(page));
+    if (memcmp(check, page, sizeof(page)) || lseek(fd, 0, SEEK_DATA) != 0) {
+        printf("ZERO_RANGE left data behind or freed the page\n");
+        goto fail;
+    }
+    
+    // Preallocating past EOF charges blocks without moving the size
+    fstat(fd, &before);
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 1 << 20, 1 << 20) < 0) {
+        perror("fallocate(KEEP_SIZE)");
+        goto fail;
+    }
+    fstat(fd, &after);
+    if (after.st_size != before.st_size || after.st_blocks <= before.st_blocks) {
+        printf("KEEP_SIZE: size %ld -> %ld, blocks %ld -> %ld\n",
+               (long)before.st_size, (long)after.st_size,
+               (long)before.st_blocks, (long)after.st_blocks);
+        goto fail;
+    }
+    printf("Preallocated 1MB: %ld -> %ld blocks\n",
+           (long)before.st_blocks, (long)after.st_blocks);
+    
+    close(fd);
+    unlink(path);
+    printf("Sparse file support OK\n");
+    return 0;
+    
+fail:
+    close(fd);
+    unlink(path);
+    return -1;
+}
+
 int main()
 {
     int fd, ret;
@@ -144,6 +1152,45 @@ int main()
         system(cmd);
     }
     
+    if (test_xattrs(TEST_FILE) < 0)
+        printf("Extended attribute test FAILED\n");
+    
+    if (test_vectored_io() < 0)
+        printf("Vectored I/O test FAILED\n");
+    
+    if (test_inline() < 0)
+        printf("Inline file test FAILED\n");
+    
+    if (test_mmap() < 0)
+        printf("mmap test FAILED\n");
+    
+    if (test_huge() < 0)
+        printf("huge=always test FAILED\n");
+    
+    if (test_sparse() < 0)
+        printf("Sparse file test FAILED\n");
+    
+    if (test_concurrent_readers() < 0)
+        printf("Concurrent reader test FAILED\n");
+    
+    if (test_copy_paths() < 0)
+        printf("Copy path test FAILED\n");
+    
+    if (test_archive() < 0)
+        printf("Archive test FAILED\n");
+    
+    if (test_bulk_create() < 0)
+        printf("Bulk create test FAILED\n");
+    
+    if (test_dcache() < 0)
+        printf("Dentry cache test FAILED\n");
+    
+    if (test_churn() < 0)
+        printf("Churn test FAILED: usage grew\n");
+    
+    if (test_mount_limits() < 0)
+        printf("Mount limit test FAILED\n");
+    
 cleanup:
     // Unmount filesystem
     printf("\nUnmounting filesystem...\n");
@@ -5,17 +5,632 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <stdint.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 #define DEVICE_PATH "/dev/simple_vma"
-#define BUFFER_SIZE (4096 * 4)  // 4 pages
+#define DEFAULT_SIZE (4096 * 4)  // module default, 4 pages
+#define SYSFS_DIR "/sys/class/simple_vma/simple_vma"
+#define PARAM_DIR "/sys/module/vma_allocation/parameters"
 
-int main()
+struct simple_vma_dirty {
+    uint64_t start;
+    uint64_t nr_pages;
+    uint64_t bitmap;
+    uint64_t nr_dirty;
+};
+
+#define SIMPLE_VMA_IOC_MAGIC 'V'
+#define SIMPLE_VMA_GET_DIRTY _IOWR(SIMPLE_VMA_IOC_MAGIC, 1, struct simple_vma_dirty)
+
+// Read one of the module's sysfs counters, -1 if unavailable
+static long read_stat(const char *name)
+{
+    char path[128];
+    long val = -1;
+    FILE *f;
+    
+    snprintf(path, sizeof(path), "%s/%s", SYSFS_DIR, name);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    if (fscanf(f, "%ld", &val) != 1)
+        val = -1;
+    fclose(f);
+    return val;
+}
+
+// Set a writable module parameter, returns 0 on success
+static int set_param(const char *name, const char *val)
+{
+    char path[128];
+    FILE *f;
+    int ret;
+    
+    snprintf(path, sizeof(path), "%s/%s", PARAM_DIR, name);
+    f = fopen(path, "w");
+    if (!f)
+        return -1;
+    ret = fputs(val, f) < 0 ? -1 : 0;
+    if (fclose(f))
+        ret = -1;
+    return ret;
+}
+
+// Print the per-node page counts ("N0=.. N1=..") if the module has them
+static void print_node_pages(const char *when)
+{
+    char line[256];
+    FILE *f;
+    
+    f = fopen(SYSFS_DIR "/node_pages", "r");
+    if (!f)
+        return;
+    if (fgets(line, sizeof(line), f))
+        printf("Buffer pages per node %s: %s", when, line);
+    fclose(f);
+}
+
+// A one-page window at a page offset must show exactly that page of the
+// buffer, and windows running past its end must be refused
+static int test_offset_window(int fd, size_t buffer_size)
+{
+    size_t pages = buffer_size / 4096;
+    off_t off = (pages - 1) * 4096;
+    char expect[64];
+    char *map;
+    
+    printf("\nTesting offset mappings:\n");
+    
+    snprintf(expect, sizeof(expect), "last page at offset %ld", (long)off);
+    if (pwrite(fd, expect, sizeof(expect), off) != sizeof(expect)) {
+        perror("pwrite");
+        return -1;
+    }
+    
+    map = mmap(NULL, 4096, PROT_READ, MAP_SHARED, fd, off);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    if (memcmp(map, expect, sizeof(expect))) {
+        printf("Window at offset %ld shows the wrong page: %.40s\n", (long)off, map);
+        munmap(map, 4096);
+        return -1;
+    }
+    munmap(map, 4096);
+    printf("Window at page %zu: %s\n", pages - 1, expect);
+    
+    map = mmap(NULL, 2 * 4096, PROT_READ, MAP_SHARED, fd, off);
+    if (map != MAP_FAILED || errno != EINVAL) {
+        printf("Window past the end of the buffer was not refused\n");
+        if (map != MAP_FAILED)
+            munmap(map, 2 * 4096);
+        return -1;
+    }
+    printf("Window past the end refused with EINVAL\n");
+    return 0;
+}
+
+// Harvest dirty bits for the first nr pages into bits, returns the count
+static long get_dirty(int fd, uint32_t *bits, size_t nr)
+{
+    struct simple_vma_dirty req = {
+        .start = 0,
+        .nr_pages = nr,
+        .bitmap = (uintptr_t)bits,
+    };
+    
+    if (ioctl(fd, SIMPLE_VMA_GET_DIRTY, &req) < 0)
+        return -1;
+    return req.nr_dirty;
+}
+
+// Only pages stored to since the last harvest are reported, and a page
+// harvested clean is caught again on its next store
+static int test_dirty_tracking(int fd, size_t buffer_size)
+{
+    size_t pages = buffer_size / 4096;
+    uint32_t bits[4] = { 0 };
+    char *map;
+    int ret = -1;
+    
+    printf("\nTesting dirty page tracking:\n");
+    
+    if (pages > 128)
+        pages = 128;
+    if (get_dirty(fd, bits, pages) < 0) {
+        if (errno == EOPNOTSUPP) {
+            printf("Module loaded without dirty_tracking=1, skipping\n");
+            return 0;
+        }
+        perror("ioctl(SIMPLE_VMA_GET_DIRTY)");
+        return -1;
+    }
+    
+    map = mmap(NULL, pages * 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    
+    // Reads dirty nothing; stores dirty exactly the pages they hit
+    printf("Reading page 0 (%c), storing to pages 0 and %zu\n", map[0], pages - 1);
+    map[0] = 'D';
+    map[(pages - 1) * 4096] = 'D';
+    memset(bits, 0, sizeof(bits));
+    if (get_dirty(fd, bits, pages) != (pages > 1 ? 2 : 1) || !(bits[0] & 1) ||
+        !(bits[(pages - 1) / 32] & (1u << ((pages - 1) % 32)))) {
+        printf("Wrong dirty set: 0x%08x\n", bits[0]);
+        goto out;
+    }
+    
+    memset(bits, 0, sizeof(bits));
+    if (get_dirty(fd, bits, pages) != 0) {
+        printf("Pages still dirty right after a harvest\n");
+        goto out;
+    }
+    
+    map[0] = 'E';
+    memset(bits, 0, sizeof(bits));
+    if (get_dirty(fd, bits, pages) != 1 || bits[0] != 1) {
+        printf("Store after harvest not caught: 0x%08x\n", bits[0]);
+        goto out;
+    }
+    printf("Dirty bits tracked across harvests (%ld mkwrite faults)\n",
+           read_stat("mkwrite_faults"));
+    ret = 0;
+    
+out:
+    munmap(map, pages * 4096);
+    return ret;
+}
+
+// A reader racing a writer on the same page must only ever see whole
+// writes: every 4K pwrite() fills the page with one byte value
+static int test_concurrent_rw(void)
 {
-    int fd, ret;
+    char page[4096];
+    int fd, i, j, torn = 0, status;
+    pid_t pid;
+    
+    printf("\nTesting concurrent read/write:\n");
+    
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("open");
+        return -1;
+    }
+    
+    memset(page, 'z', sizeof(page));
+    if (pwrite(fd, page, sizeof(page), 0) != sizeof(page)) {
+        perror("pwrite");
+        close(fd);
+        return -1;
+    }
+    
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(fd);
+        return -1;
+    }
+    if (pid == 0) {
+        for (i = 0; i < 20000; i++) {
+            memset(page, 'a' + i % 26, sizeof(page));
+            if (pwrite(fd, page, sizeof(page), 0) != sizeof(page))
+                _exit(1);
+        }
+        _exit(0);
+    }
+    
+    for (i = 0; i < 20000 && !torn; i++) {
+        if (pread(fd, page, sizeof(page), 0) != sizeof(page))
+            break;
+        for (j = 1; j < (int)sizeof(page); j++) {
+            if (page[j] != page[0]) {
+                printf("Torn read: byte %d is '%c', byte 0 is '%c'\n", j, page[j], page[0]);
+                torn = 1;
+                break;
+            }
+        }
+    }
+    waitpid(pid, &status, 0);
+    close(fd);
+    
+    if (torn || !WIFEXITED(status) || WEXITSTATUS(status))
+        return -1;
+    printf("No torn reads in %d reads (%ld optimistic reads retried)\n", i,
+           read_stat("read_retries"));
+    return 0;
+}
+
+// Stores through a MAP_PRIVATE mapping must not reach the device buffer
+static int test_private_cow(int fd)
+{
+    char before[16], after[16];
+    char *map;
+    
+    printf("\nTesting MAP_PRIVATE copy-on-write:\n");
+    
+    if (pread(fd, before, sizeof(before), 0) != sizeof(before)) {
+        perror("pread");
+        return -1;
+    }
+    map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    memset(map, 'P', sizeof(after));
+    munmap(map, 4096);
+    
+    if (pread(fd, after, sizeof(after), 0) != sizeof(after) ||
+        memcmp(before, after, sizeof(before))) {
+        printf("Private store leaked into the device buffer\n");
+        return -1;
+    }
+    printf("Device buffer unchanged after private store\n");
+    return 0;
+}
+
+// With per_open_buffers every open() sees its own, initially zeroed buffer
+static int test_per_open(void)
+{
+    char msg[] = "only in the first buffer", check[sizeof(msg)];
+    long private_pages;
+    int fd1, fd2, ret = -1;
+    char *map;
+    
+    printf("\nTesting per-open buffers:\n");
+    
+    if (set_param("per_open_buffers", "Y") < 0) {
+        printf("Cannot set per_open_buffers, skipping\n");
+        return 0;
+    }
+    private_pages = read_stat("private_pages");
+    
+    fd1 = open(DEVICE_PATH, O_RDWR);
+    fd2 = open(DEVICE_PATH, O_RDWR);
+    if (fd1 < 0 || fd2 < 0) {
+        perror("open");
+        goto out;
+    }
+    
+    map = mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd1, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        goto out;
+    }
+    memcpy(map, msg, sizeof(msg));
+    munmap(map, 4096);
+    
+    if (pread(fd1, check, sizeof(check), 0) != sizeof(check) || memcmp(check, msg, sizeof(msg))) {
+        printf("First open does not see its own store\n");
+        goto out;
+    }
+    if (pread(fd2, check, sizeof(check), 0) != sizeof(check) || check[0] != 0) {
+        printf("Second open sees the first one's data\n");
+        goto out;
+    }
+    printf("Buffers are independent, %ld pages allocated lazily\n",
+           read_stat("private_pages") - private_pages);
+    ret = 0;
+    
+out:
+    if (fd1 >= 0)
+        close(fd1);
+    if (fd2 >= 0)
+        close(fd2);
+    set_param("per_open_buffers", "N");
+    return ret;
+}
+
+// ---- Benchmark mode (test_vma -b) ----
+//
+// Measures what the module parameters trade off: first-touch fault cost
+// (map_mode, fault_around_pages, backing=1 huge pages, numa_policy),
+// steady-state bandwidth through the mapping against read()/write(),
+// parallel faulting and copying from several threads, and munmap cost.
+// The buffer contents are overwritten.
+
+#define BENCH_MIN_SIZE (64 * 1024)
+#define BENCH_MAX_THREADS 64
+
+struct bench_thread {
+    int fd;
+    char *map;          // this thread's slice of the shared mapping
+    off_t off;          // slice offset in the device
+    size_t len;
+    int reps;
+    int use_mmap;       // copy through the mapping, else pread()
+    char *buf;
+    long errors;
+};
+
+static pthread_barrier_t bench_start, bench_mid;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Touch one byte per page so every page is faulted in exactly once
+static void touch_pages(char *map, size_t len, int write)
+{
+    volatile char *p = map;
+    size_t off;
+    
+    for (off = 0; off < len; off += 4096) {
+        if (write)
+            p[off] = 1;
+        else
+            (void)p[off];
+    }
+}
+
+// Bytes per nanosecond is GB/s
+static double gbps(size_t bytes, uint64_t ns)
+{
+    return ns ? (double)bytes / ns : 0;
+}
+
+// Fault cost per page for read and write first touch of a fresh mapping,
+// and what the munmap of the populated mapping costs
+static int bench_first_touch(int fd, size_t size)
+{
+    unsigned long nr = size / 4096;
+    uint64_t touch[2], unmap[2], start;
+    long faults[2];
+    char *map;
+    int write;
+    
+    for (write = 0; write < 2; write++) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            return -1;
+        }
+        faults[write] = read_stat("faults");
+        start = now_ns();
+        touch_pages(map, size, write);
+        touch[write] = now_ns() - start;
+        faults[write] = read_stat("faults") - faults[write];
+        
+        start = now_ns();
+        munmap(map, size);
+        unmap[write] = now_ns() - start;
+    }
+    
+    printf("%10zu %12.1f %12.1f %12.1f %12.2f %12.1f\n", size / 1024,
+           (double)touch[0] / nr, (double)touch[1] / nr,
+           (double)(unmap[0] + unmap[1]) / 2 / nr,
+           (double)faults[0] / nr, gbps(size, touch[1]));
+    return 0;
+}
+
+// Copy the whole buffer reps times each way through an already populated
+// mapping and through pread()/pwrite()
+static int bench_bandwidth(int fd, size_t size, int reps)
+{
+    uint64_t start, ns[4];
+    char *map, *buf;
+    int i;
+    
+    buf = malloc(size);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        free(buf);
+        return -1;
+    }
+    memset(buf, 'b', size);
+    touch_pages(map, size, 1);
+    
+    start = now_ns();
+    for (i = 0; i < reps; i++)
+        memcpy(buf, map, size);
+    ns[0] = now_ns() - start;
+    
+    start = now_ns();
+    for (i = 0; i < reps; i++)
+        memcpy(map, buf, size);
+    ns[1] = now_ns() - start;
+    
+    start = now_ns();
+    for (i = 0; i < reps; i++) {
+        if (pread(fd, buf, size, 0) != (ssize_t)size)
+            break;
+    }
+    ns[2] = i == reps ? now_ns() - start : 0;
+    
+    start = now_ns();
+    for (i = 0; i < reps; i++) {
+        if (pwrite(fd, buf, size, 0) != (ssize_t)size)
+            break;
+    }
+    ns[3] = i == reps ? now_ns() - start : 0;
+    
+    printf("%10zu %12.2f %12.2f %12.2f %12.2f\n", size / 1024,
+           gbps(size * reps, ns[0]), gbps(size * reps, ns[1]),
+           gbps(size * reps, ns[2]), gbps(size * reps, ns[3]));
+    
+    munmap(map, size);
+    free(buf);
+    return ns[2] && ns[3] ? 0 : -1;
+}
+
+// Fault in the slice, then copy it out reps times
+static void *bench_thread_fn(void *arg)
+{
+    struct bench_thread *t = arg;
+    int i;
+    
+    pthread_barrier_wait(&bench_start);
+    touch_pages(t->map, t->len, 0);
+    pthread_barrier_wait(&bench_mid);
+    
+    for (i = 0; i < t->reps; i++) {
+        if (t->use_mmap)
+            memcpy(t->buf, t->map, t->len);
+        else if (pread(t->fd, t->buf, t->len, t->off) != (ssize_t)t->len)
+            t->errors++;
+    }
+    return NULL;
+}
+
+// nr_threads threads fault their own slice of one fresh mapping in
+// parallel, then copy it out through the mapping or with pread()
+static int bench_threads(int fd, size_t size, int nr_threads, int reps, int use_mmap)
+{
+    struct bench_thread threads[BENCH_MAX_THREADS];
+    pthread_t tids[BENCH_MAX_THREADS];
+    size_t slice = size / nr_threads / 4096 * 4096;
+    uint64_t start, fault_ns, copy_ns;
+    long errors = 0;
+    char *map;
+    int i;
+    
+    if (!slice)
+        return 0;
+    
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return -1;
+    }
+    
+    pthread_barrier_init(&bench_start, NULL, nr_threads + 1);
+    pthread_barrier_init(&bench_mid, NULL, nr_threads + 1);
+    for (i = 0; i < nr_threads; i++) {
+        threads[i] = (struct bench_thread) {
+            .fd = fd,
+            .map = map + i * slice,
+            .off = i * slice,
+            .len = slice,
+            .reps = reps,
+            .use_mmap = use_mmap,
+            .buf = malloc(slice),
+        };
+        if (!threads[i].buf) {
+            perror("malloc");
+            exit(1);
+        }
+        pthread_create(&tids[i], NULL, bench_thread_fn, &threads[i]);
+    }
+    
+    pthread_barrier_wait(&bench_start);
+    start = now_ns();
+    pthread_barrier_wait(&bench_mid);
+    fault_ns = now_ns() - start;
+    start = now_ns();
+    for (i = 0; i < nr_threads; i++) {
+        pthread_join(tids[i], NULL);
+        errors += threads[i].errors;
+        free(threads[i].buf);
+    }
+    copy_ns = now_ns() - start;
+    
+    pthread_barrier_destroy(&bench_start);
+    pthread_barrier_destroy(&bench_mid);
+    munmap(map, size);
+    
+    printf("%10d %10s %12.1f %12.2f\n", nr_threads, use_mmap ? "mmap" : "pread",
+           (double)fault_ns / (slice * nr_threads / 4096),
+           gbps(slice * nr_threads * reps, copy_ns));
+    return errors ? -1 : 0;
+}
+
+static int run_bench(size_t buffer_size, int max_threads, int reps)
+{
+    size_t size, min_size = buffer_size < BENCH_MIN_SIZE ? buffer_size : BENCH_MIN_SIZE;
+    int fd, threads, ret = 0;
+    
+    printf("=== simple_vma mmap benchmark ===\n");
+    printf("buffer %zu KB, up to %d threads, %d reps\n", buffer_size / 1024, max_threads, reps);
+    
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("open");
+        printf("Make sure simple_vma module is loaded and device exists\n");
+        return 1;
+    }
+    
+    printf("\nFirst touch (ns/page) and munmap cost:\n");
+    printf("%10s %12s %12s %12s %12s %12s\n",
+           "size KB", "read touch", "write touch", "munmap", "faults/page", "touch GB/s");
+    for (size = min_size; size < buffer_size; size *= 4)
+        ret |= bench_first_touch(fd, size);
+    ret |= bench_first_touch(fd, buffer_size);
+    
+    printf("\nSteady state bandwidth (GB/s):\n");
+    printf("%10s %12s %12s %12s %12s\n", "size KB", "mmap read", "mmap write", "read()", "write()");
+    for (size = min_size; size < buffer_size; size *= 4)
+        ret |= bench_bandwidth(fd, size, reps);
+    ret |= bench_bandwidth(fd, buffer_size, reps);
+    
+    printf("\nThreads faulting and copying disjoint slices:\n");
+    printf("%10s %10s %12s %12s\n", "threads", "copy", "fault ns/pg", "GB/s");
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        ret |= bench_threads(fd, buffer_size, threads, reps, 1);
+        ret |= bench_threads(fd, buffer_size, threads, reps, 0);
+    }
+    
+    close(fd);
+    if (ret) {
+        printf("Benchmark FAILED\n");
+        return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-b [-t threads] [-r reps]]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    int fd, ret, opt, bench = 0, max_threads = 4, reps = 10;
     char *mapped_mem;
     char write_buf[] = "Hello from userspace via mmap!";
     char read_buf[256];
+    long faults, huge_faults, pages_mapped;
+    size_t buffer_size = DEFAULT_SIZE;
+    int nr_touch;
+    
+    while ((opt = getopt(argc, argv, "bt:r:")) != -1) {
+        switch (opt) {
+        case 'b': bench = 1; break;
+        case 't': max_threads = atoi(optarg); break;
+        case 'r': reps = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads < 1 || max_threads > BENCH_MAX_THREADS || reps < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    
+    // The buffer size is a module parameter
+    if (read_stat("size") > 0)
+        buffer_size = read_stat("size");
+    
+    if (bench)
+        return run_bench(buffer_size, max_threads, reps);
     
     printf("=== VMA Memory Mapping Test ===\n");
     
@@ -55,9 +670,12 @@ int main()
     // Test memory mapping
     printf("\nTesting memory mapping:\n");
     
+    nr_touch = buffer_size / 4096 < 4 ? buffer_size / 4096 : 4;
+    printf("Buffer size: %zu bytes\n", buffer_size);
+    
     // Map device memory
     printf("Mapping device memory...\n");
-    mapped_mem = mmap(NULL, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    mapped_mem = mmap(NULL, buffer_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (mapped_mem == MAP_FAILED) {
         perror("mmap");
         close(fd);
@@ -66,6 +684,13 @@ int main()
     
     printf("Memory mapped successfully at address: %p\n", mapped_mem);
     
+    faults = read_stat("faults");
+    huge_faults = read_stat("huge_faults");
+    pages_mapped = read_stat("pages_mapped");
+    
+    // With numa_policy=1 or 2 pages only appear here as they are touched
+    print_node_pages("before touching");
+    
     // Read initial content via mmap
     printf("Initial content via mmap: %.50s\n", mapped_mem);
     
@@ -76,12 +701,19 @@ int main()
     
     // Test page fault by accessing different pages
     printf("\nTesting page faults across multiple pages:\n");
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < nr_touch; i++) {
         char *page_addr = mapped_mem + (i * 4096);
         sprintf(page_addr, "Page %d content via mmap", i);
         printf("Page %d: %s\n", i, page_addr);
     }
     
+    // With fault-around or eager mapping this is fewer faults than pages
+    if (faults >= 0 && pages_mapped >= 0)
+        printf("Touching %d pages took %ld faults (%ld huge), %ld pages mapped\n", nr_touch,
+               read_stat("faults") - faults, read_stat("huge_faults") - huge_faults,
+               read_stat("pages_mapped") - pages_mapped);
+    print_node_pages("after touching");
+    
     // Read back via regular read to verify
     printf("\nVerifying via regular read:\n");
     lseek(fd, 0, SEEK_SET);
@@ -99,21 +731,37 @@ int main()
              "Large data block: %s. This tests the VMA fault handler with larger writes.",
              "ABCDEFGHIJKLMNOPQRSTUVWXYZ");
     
-    if (strlen(large_data) < BUFFER_SIZE) {
+    if (strlen(large_data) < buffer_size) {
         strcpy(mapped_mem, large_data);
         printf("Large write successful: %.80s...\n", mapped_mem);
     }
     
     // Cleanup
     printf("\nCleaning up...\n");
-    ret = munmap(mapped_mem, BUFFER_SIZE);
+    ret = munmap(mapped_mem, buffer_size);
     if (ret < 0) {
         perror("munmap");
     } else {
         printf("Memory unmapped successfully\n");
     }
     
+    ret = test_offset_window(fd, buffer_size);
+    if (test_dirty_tracking(fd, buffer_size) < 0)
+        ret = -1;
+    if (test_private_cow(fd) < 0)
+        ret = -1;
     close(fd);
+    
+    if (test_concurrent_rw() < 0)
+        ret = -1;
+    
+    if (test_per_open() < 0)
+        ret = -1;
+    
+    if (ret < 0) {
+        printf("VMA test FAILED\n");
+        return 1;
+    }
     printf("VMA test completed successfully\n");
     return 0;
 }
\ No newline at end of file
@@ -7,67 +7,624 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/mman.h>
+#include <linux/log2.h>
+#include <linux/huge_mm.h>
+#include <linux/highmem.h>
+#include <linux/cma.h>
+#include <linux/dma-map-ops.h>
+#include <linux/bitmap.h>
+#include <linux/gfp.h>
+#include <linux/nodemask.h>
+#include <linux/mount.h>
+#include <linux/pseudo_fs.h>
 
 #define DEVICE_NAME "simple_vma"
-#define BUFFER_SIZE (PAGE_SIZE * 4)  // 4 pages
+#define CHUNK_ORDER (PMD_SHIFT - PAGE_SHIFT)    // one PMD worth of pages
+#define LOCK_CHUNK_SHIFT 16                     // read()/write() lock granularity, 64 KB
+#define LOCK_CHUNK_SIZE (1UL << LOCK_CHUNK_SHIFT)
+#define SIMPLE_VMA_FS_MAGIC 0x53564d41          // "SVMA", the buffer inode pseudo fs
+
+// Harvest the dirty bits of a range of buffer pages.  Bit i of the
+// bitmap (bit i % 32 of __u32 word i / 32) is page start + i.  Every page
+// reported is clean again and write-protected in all mappings, so the
+// next store to it is caught.
+struct simple_vma_dirty {
+    __u64 start;        // first buffer page
+    __u64 nr_pages;
+    __u64 bitmap;       // user pointer, DIV_ROUND_UP(nr_pages, 32) __u32 words
+    __u64 nr_dirty;     // out: pages reported dirty
+};
+
+#define SIMPLE_VMA_IOC_MAGIC 'V'
+#define SIMPLE_VMA_GET_DIRTY _IOWR(SIMPLE_VMA_IOC_MAGIC, 1, struct simple_vma_dirty)
+
+// How pages get into the page tables
+enum {
+    MAP_MODE_FAULT,     // one page per fault
+    MAP_MODE_AROUND,    // fault in the surrounding fault_around_pages window
+    MAP_MODE_EAGER,     // map the whole range at mmap time
+};
+
+static int map_mode = MAP_MODE_AROUND;
+module_param(map_mode, int, 0644);
+MODULE_PARM_DESC(map_mode, "0 = one page per fault, 1 = fault-around, 2 = map everything at mmap");
+
+static unsigned int fault_around_pages = 16;
+module_param(fault_around_pages, uint, 0644);
+MODULE_PARM_DESC(fault_around_pages, "Pages mapped per fault in fault-around mode");
+
+// Where the buffer memory comes from
+enum {
+    BACKING_VMALLOC,    // scattered 4K pages
+    BACKING_HUGE,       // PMD-sized, PMD-aligned chunks from the buddy allocator
+    BACKING_CMA,        // one contiguous block from the default CMA area
+};
+
+static unsigned long buffer_size = PAGE_SIZE * 4;
+module_param(buffer_size, ulong, 0444);
+MODULE_PARM_DESC(buffer_size, "Buffer size in bytes (rounded up to a page, or to 2 MB for huge/CMA)");
+
+static int backing = BACKING_VMALLOC;
+module_param(backing, int, 0444);
+MODULE_PARM_DESC(backing, "0 = vmalloc, 1 = 2 MB contiguous chunks, 2 = CMA");
+
+static bool per_open_buffers;
+module_param(per_open_buffers, bool, 0644);
+MODULE_PARM_DESC(per_open_buffers, "Give every open() its own buffer instead of the shared one");
+
+static bool dirty_tracking;
+module_param(dirty_tracking, bool, 0444);
+MODULE_PARM_DESC(dirty_tracking, "Track pages written through shared mappings (no PMD mappings)");
+
+// Which NUMA node buffer pages land on
+enum {
+    NUMA_AT_LOAD,       // allocated by insmod, on whatever node it ran
+    NUMA_FIRST_TOUCH,   // allocated on first fault or write, mbind() respected
+    NUMA_INTERLEAVE,    // allocated on first touch, page i on the i-th online node
+};
+
+static int numa_policy = NUMA_AT_LOAD;
+module_param(numa_policy, int, 0444);
+MODULE_PARM_DESC(numa_policy, "0 = allocate at load, 1 = first touch, 2 = interleave (vmalloc backing only)");
+
+// write() into a chunk holds lock and bumps seq around the copy.  read()
+// copies without either and retries under lock if seq moved, so readers
+// never write a shared cache line and disjoint writers run in parallel.
+struct simple_vma_lock {
+    struct mutex lock;
+    seqcount_mutex_t seq;
+};
+
+// Buffer layout: size bytes in nr_pages pages.  For huge and CMA backing
+// every PMD-aligned run of pages is physically contiguous and starts on a
+// PMD-aligned pfn.  Lazy buffers start with every slot NULL and get a
+// zeroed page on first touch.
+//
+// With dirty tracking a page's bit is set before any mapping of it can
+// become writable, and cleared only before all its PTEs are zapped.
+struct simple_vma_buf {
+    size_t size;
+    unsigned long nr_pages;
+    struct page **pages;
+    char *vaddr;            // vmalloc backing only, for vfree()
+    int backing;
+    bool lazy;
+    struct simple_vma_lock *locks;  // one per LOCK_CHUNK_SIZE of buffer
+    unsigned long *dirty;   // one bit per page, NULL without tracking
+    struct mutex dirty_lock;    // one harvester at a time
+    struct inode *inode;    // own address_space, every open of buf maps through it
+};
 
 struct simple_vma_dev {
     struct cdev cdev;
     struct class *class;
     struct device *device;
-    char *buffer;
-    struct mutex mutex;
+    struct simple_vma_buf buf;  // shared by every open without per_open_buffers
+    
+    // Statistics
+    atomic_long_t faults;
+    atomic_long_t huge_faults;
+    atomic_long_t pages_mapped;
+    atomic_long_t private_pages;
+    atomic_long_t mkwrite_faults;
+    atomic_long_t read_retries;
+    atomic_long_t *node_pages;  // buffer pages per node, nr_node_ids entries
 };
 
 static struct simple_vma_dev *vma_dev;
+static struct vfsmount *simple_vma_mnt;
+static int simple_vma_mnt_count;
 static dev_t dev_number;
 static int major_number;
 
+// The (index % online nodes)-th online node
+static int example_interleave_node(pgoff_t index)
+{
+    unsigned int target = index % num_online_nodes();
+    int nid;
+    
+    for_each_online_node(nid) {
+        if (!target--)
+            return nid;
+    }
+    return numa_node_id();
+}
+
+// A zeroed page for slot index of a lazy buffer.  Unless interleaving,
+// a fault allocates under the mapping's mempolicy (so mbind() on the
+// mapping works) and write() under the task's; both default to the
+// local node, which makes placement first touch.
+static struct page *example_alloc_page(pgoff_t index, struct vm_area_struct *vma,
+                                       unsigned long addr)
+{
+    gfp_t gfp = GFP_HIGHUSER | __GFP_ZERO;
+    
+    if (numa_policy == NUMA_INTERLEAVE)
+        return alloc_pages_node(example_interleave_node(index), gfp, 0);
+    if (vma)
+        return alloc_page_vma(gfp, vma, addr);
+    return alloc_page(gfp);
+}
+
+// Page at index of buf.  A missing page of a lazy buffer is allocated
+// when alloc is set, for the fault at addr in vma if there is one;
+// concurrent callers race with cmpxchg() and the loser frees its copy,
+// so no lock is needed.
+static struct page *example_buf_page(struct simple_vma_buf *buf, pgoff_t index, bool alloc,
+                                     struct vm_area_struct *vma, unsigned long addr)
+{
+    struct page *page = READ_ONCE(buf->pages[index]);
+    struct page *old;
+    
+    if (page || !alloc)
+        return page;
+    
+    page = example_alloc_page(index, vma, addr);
+    if (!page)
+        return NULL;
+    
+    old = cmpxchg(&buf->pages[index], NULL, page);
+    if (old) {
+        __free_page(page);
+        return old;
+    }
+    
+    atomic_long_inc(&vma_dev->node_pages[page_to_nid(page)]);
+    if (buf != &vma_dev->buf)
+        atomic_long_inc(&vma_dev->private_pages);
+    return page;
+}
+
+// Copy between user memory and buf a page at a time.  Holes in a lazy
+// buffer read as zeroes and are filled in on write.
+static ssize_t example_buf_copy(struct simple_vma_buf *buf, char __user *ubuf, size_t count,
+                                loff_t pos, bool write)
+{
+    size_t done = 0, off, len, rem;
+    struct page *page;
+    void *kaddr;
+    
+    while (done < count) {
+        off = offset_in_page(pos + done);
+        len = min_t(size_t, count - done, PAGE_SIZE - off);
+        page = example_buf_page(buf, (pos + done) >> PAGE_SHIFT, write, NULL, 0);
+    
+        if (!page && write)
+            return done ? done : -ENOMEM;
+    
+        if (!page) {
+            rem = clear_user(ubuf + done, len);
+        } else {
+            kaddr = kmap_local_page(page);
+            if (write && buf->dirty)
+                set_bit((pos + done) >> PAGE_SHIFT, buf->dirty);
+            if (write)
+                rem = copy_from_user(kaddr + off, ubuf + done, len);
+            else
+                rem = copy_to_user(ubuf + done, kaddr + off, len);
+            kunmap_local(kaddr);
+        }
+    
+        done += len - rem;
+        if (rem)
+            return done ? done : -EFAULT;
+    }
+    
+    return done;
+}
+
+// Split [pos, pos + count) at lock chunk boundaries and copy each piece
+// under that chunk's protocol.  Returns bytes copied or an errno if
+// nothing was.
+static ssize_t example_buf_rw(struct simple_vma_buf *buf, char __user *ubuf, size_t count,
+                              loff_t pos, bool write)
+{
+    struct simple_vma_lock *l;
+    size_t done = 0, len;
+    unsigned int seq;
+    ssize_t ret;
+    
+    while (done < count) {
+        l = &buf->locks[(pos + done) >> LOCK_CHUNK_SHIFT];
+        len = min_t(size_t, count - done, LOCK_CHUNK_SIZE - ((pos + done) & (LOCK_CHUNK_SIZE - 1)));
+        
+        // Optimistic read; a writer during the copy sends us to the
+        // locked path, which always completes
+        ret = -EAGAIN;
+        if (!write) {
+            seq = raw_read_seqcount(&l->seq);
+            if (!(seq & 1)) {
+                ret = example_buf_copy(buf, ubuf + done, len, pos + done, false);
+                if (read_seqcount_retry(&l->seq, seq)) {
+                    atomic_long_inc(&vma_dev->read_retries);
+                    ret = -EAGAIN;
+                }
+            }
+        }
+        
+        if (ret == -EAGAIN) {
+            if (mutex_lock_interruptible(&l->lock))
+                return done ? done : -ERESTARTSYS;
+            if (write)
+                write_seqcount_begin(&l->seq);
+            ret = example_buf_copy(buf, ubuf + done, len, pos + done, write);
+            if (write)
+                write_seqcount_end(&l->seq);
+            mutex_unlock(&l->lock);
+        }
+        
+        if (ret <= 0)
+            return done ? done : ret;
+        done += ret;
+        if (ret < len)
+            break;
+    }
+    
+    return done;
+}
+
+// Free the first nr backing pages of a buffer that is not vmalloc'ed
+static void example_free_backing(struct simple_vma_buf *buf, unsigned long nr)
+{
+    unsigned long i;
+    
+    if (buf->backing == BACKING_CMA) {
+        cma_release(dev_get_cma_area(NULL), buf->pages[0], buf->nr_pages);
+        return;
+    }
+    for (i = 0; i < nr; i++) {
+        if (buf->pages[i])
+            __free_page(buf->pages[i]);
+    }
+}
+
+// Allocate the shared buffer.  Every backing fills in buf->pages, which
+// the fault and read/write paths work from.
+static int example_alloc_buffer(struct simple_vma_buf *buf)
+{
+    struct page *page;
+    unsigned long i, j;
+    int ret = -ENOMEM;
+    
+    buf->pages = kvmalloc_array(buf->nr_pages, sizeof(*buf->pages), GFP_KERNEL);
+    if (!buf->pages)
+        return -ENOMEM;
+    
+    switch (buf->backing) {
+    case BACKING_VMALLOC:
+        buf->vaddr = vmalloc_user(buf->size);
+        if (!buf->vaddr)
+            goto err_free_array;
+        for (i = 0; i < buf->nr_pages; i++)
+            buf->pages[i] = vmalloc_to_page(buf->vaddr + (i << PAGE_SHIFT));
+        return 0;
+    
+    case BACKING_HUGE:
+        for (i = 0; i < buf->nr_pages; i += 1UL << CHUNK_ORDER) {
+            page = alloc_pages(GFP_KERNEL | __GFP_NOWARN, CHUNK_ORDER);
+            if (!page) {
+                example_free_backing(buf, i);
+                goto err_free_array;
+            }
+            // Give every 4K page its own refcount so private mappings can
+            // insert and COW them one at a time
+            split_page(page, CHUNK_ORDER);
+            for (j = 0; j < (1UL << CHUNK_ORDER); j++)
+                buf->pages[i + j] = nth_page(page, j);
+        }
+        return 0;
+    
+    case BACKING_CMA:
+        if (!dev_get_cma_area(NULL)) {
+            pr_err("simple_vma: No default CMA area (CONFIG_DMA_CMA, cma=)\n");
+            ret = -ENODEV;
+            goto err_free_array;
+        }
+        page = cma_alloc(dev_get_cma_area(NULL), buf->nr_pages, CHUNK_ORDER, false);
+        if (!page)
+            goto err_free_array;
+        for (i = 0; i < buf->nr_pages; i++)
+            buf->pages[i] = nth_page(page, i);
+        return 0;
+    
+    default:
+        ret = -EINVAL;
+        goto err_free_array;
+    }
+    
+err_free_array:
+    kvfree(buf->pages);
+    return ret;
+}
+
+// Add delta to the node counters of every page buf has, returns the
+// number of pages
+static unsigned long example_account_pages(struct simple_vma_buf *buf, long delta)
+{
+    unsigned long i, nr = 0;
+    
+    for (i = 0; i < buf->nr_pages; i++) {
+        if (buf->pages[i]) {
+            atomic_long_add(delta, &vma_dev->node_pages[page_to_nid(buf->pages[i])]);
+            nr++;
+        }
+    }
+    return nr;
+}
+
+// Returns the number of pages freed
+static unsigned long example_free_buffer(struct simple_vma_buf *buf)
+{
+    unsigned long nr = example_account_pages(buf, -1);
+    
+    if (buf->vaddr)
+        vfree(buf->vaddr);
+    else
+        example_free_backing(buf, buf->nr_pages);
+    kvfree(buf->pages);
+    kvfree(buf->locks);
+    kvfree(buf->dirty);
+    if (buf->inode)
+        iput(buf->inode);
+    return nr;
+}
+
+// Locks, dirty bitmap and inode, for the shared buffer and private ones
+// alike.  Frees whatever it allocated on failure.
+//
+// Each buffer gets an inode of its own on the module's pseudo fs, like
+// DRM does for its devices.  open() points f_mapping at it, so every
+// mapping of the buffer, through whichever device node, lands in one
+// address_space and unmap_mapping_range() reaches exactly those.
+static int example_alloc_meta(struct simple_vma_buf *buf)
+{
+    unsigned long i, nr_locks = DIV_ROUND_UP(buf->size, LOCK_CHUNK_SIZE);
+    struct inode *inode;
+    
+    mutex_init(&buf->dirty_lock);
+    buf->locks = kvmalloc_array(nr_locks, sizeof(*buf->locks), GFP_KERNEL);
+    if (!buf->locks)
+        return -ENOMEM;
+    for (i = 0; i < nr_locks; i++) {
+        mutex_init(&buf->locks[i].lock);
+        seqcount_mutex_init(&buf->locks[i].seq, &buf->locks[i].lock);
+    }
+    
+    if (dirty_tracking) {
+        buf->dirty = kvcalloc(BITS_TO_LONGS(buf->nr_pages), sizeof(long), GFP_KERNEL);
+        if (!buf->dirty)
+            goto err_free_locks;
+    }
+    
+    inode = alloc_anon_inode(simple_vma_mnt->mnt_sb);
+    if (IS_ERR(inode))
+        goto err_free_dirty;
+    buf->inode = inode;
+    return 0;
+    
+err_free_dirty:
+    kvfree(buf->dirty);
+    buf->dirty = NULL;
+err_free_locks:
+    kvfree(buf->locks);
+    buf->locks = NULL;
+    return -ENOMEM;
+}
+
+// Initialize buffer with pattern
+static void example_fill_buffer(struct simple_vma_buf *buf)
+{
+    unsigned long i;
+    void *kaddr;
+    
+    for (i = 0; i < buf->nr_pages; i++) {
+        kaddr = kmap_local_page(buf->pages[i]);
+        memset(kaddr, 0x42, PAGE_SIZE);
+        if (!i)
+            sprintf(kaddr, "Hello from kernel VMA example!\n");
+        kunmap_local(kaddr);
+    }
+}
+
 // VMA operations for our device
 static void example_vma_open(struct vm_area_struct *vma)
 {
-    pr_info("simple_vma: VMA opened - start: 0x%lx, end: 0x%lx, size: %lu\n",
+    pr_debug("simple_vma: VMA opened - start: 0x%lx, end: 0x%lx, size: %lu\n",
             vma->vm_start, vma->vm_end, vma->vm_end - vma->vm_start);
 }
 
 static void example_vma_close(struct vm_area_struct *vma)
 {
-    pr_info("simple_vma: VMA closed - start: 0x%lx, end: 0x%lx\n",
+    pr_debug("simple_vma: VMA closed - start: 0x%lx, end: 0x%lx\n",
             vma->vm_start, vma->vm_end);
 }
 
-static vm_fault_t example_vma_fault(struct vm_fault *vmf)
+// Whether addr already has a PTE.  vmf_insert_pfn() reports an
+// existing entry as success, so the PFNMAP path asks first to keep
+// pages_mapped counting only slots it actually filled.
+static bool example_pte_present(struct vm_area_struct *vma, unsigned long addr)
 {
-    struct vm_area_struct *vma = vmf->vma;
+    spinlock_t *ptl;
+    pte_t *ptep;
+    
+    if (follow_pte(vma->vm_mm, addr, &ptep, &ptl))
+        return false;
+    pte_unmap_unlock(ptep, ptl);
+    return true;
+}
+
+// Map the buffer pages behind [addr, end) of the VMA, skipping pages that
+// are already mapped and, in a lazy buffer, pages that do not exist yet.
+// Returns the number of pages mapped or an errno.
+static long example_map_range(struct vm_area_struct *vma, unsigned long addr, unsigned long end)
+{
+    struct simple_vma_buf *buf = vma->vm_private_data;
+    unsigned long nr, left;
     struct page *page;
-    unsigned long offset;
-    void *page_ptr;
+    pgoff_t index;
+    long mapped = 0;
+    vm_fault_t ret;
+    int err;
+    
+    if (vma->vm_flags & VM_PFNMAP) {
+        for (; addr < end; addr += PAGE_SIZE) {
+            page = READ_ONCE(buf->pages[linear_page_index(vma, addr)]);
+            if (!page || example_pte_present(vma, addr))
+                continue;
+            ret = vmf_insert_pfn(vma, addr, page_to_pfn(page));
+            if (ret & VM_FAULT_ERROR)
+                return ret == VM_FAULT_OOM ? -ENOMEM : -EFAULT;
+            mapped++;
+        }
+        return mapped;
+    }
     
-    pr_info("simple_vma: Page fault at address: 0x%lx, page offset: %lu\n",
-            vmf->address, vmf->pgoff);
+    while (addr < end) {
+        index = linear_page_index(vma, addr);
+        if (!READ_ONCE(buf->pages[index])) {
+            addr += PAGE_SIZE;
+            continue;
+        }
     
-    // Calculate offset in our buffer
-    offset = (vmf->address - vma->vm_start) + (vma->vm_pgoff << PAGE_SHIFT);
+        // Longest run of present pages from here
+        for (nr = 1; addr + (nr << PAGE_SHIFT) < end; nr++) {
+            if (!READ_ONCE(buf->pages[index + nr]))
+                break;
+        }
     
-    if (offset >= BUFFER_SIZE) {
-        pr_err("simple_vma: Fault beyond buffer size\n");
-        return VM_FAULT_SIGBUS;
+        left = nr;
+        err = vm_insert_pages(vma, addr, buf->pages + index, &left);
+        mapped += nr - left;
+        addr += (nr - left) << PAGE_SHIFT;
+    
+        // -EBUSY: something is already mapped there, step over it
+        if (err == -EBUSY)
+            addr += PAGE_SIZE;
+        else if (err)
+            return err;
     }
     
-    // Get the page for this offset
-    page_ptr = vma_dev->buffer + (vmf->pgoff * PAGE_SIZE);
-    page = vmalloc_to_page(page_ptr);
+    return mapped;
+}
+
+// Map the fault_around_pages-aligned window around the faulting address,
+// clipped to the VMA.  The faulting page itself is always among the ones
+// tried.
+static vm_fault_t example_vma_fault_around(struct vm_fault *vmf)
+{
+    struct vm_area_struct *vma = vmf->vma;
+    unsigned long window = rounddown_pow_of_two(max(fault_around_pages, 1U)) << PAGE_SHIFT;
+    unsigned long addr, end;
+    long mapped;
+    
+    addr = max(ALIGN_DOWN(vmf->address, window), vma->vm_start);
+    end = min(ALIGN_DOWN(vmf->address, window) + window, vma->vm_end);
+    
+    mapped = example_map_range(vma, addr, end);
+    if (mapped < 0)
+        return vmf_error(mapped);
+    
+    atomic_long_add(mapped, &vma_dev->pages_mapped);
+    return VM_FAULT_NOPAGE;
+}
+
+// MAP_PRIVATE needs no help here: pages are inserted read-only into a
+// private mapping, and on a write fault the core copies the page we
+// return into an anonymous one, so the buffer itself is never written.
+static vm_fault_t example_vma_fault(struct vm_fault *vmf)
+{
+    struct vm_area_struct *vma = vmf->vma;
+    struct simple_vma_buf *buf = vma->vm_private_data;
+    struct page *page;
+    
+    atomic_long_inc(&vma_dev->faults);
     
-    if (!page) {
-        pr_err("simple_vma: No page found\n");
+    // vmf->pgoff already includes vm_pgoff, so it is the buffer page.
+    // mmap keeps every VMA inside the buffer; this only guards against
+    // a bug there.
+    if (vmf->pgoff >= buf->nr_pages)
         return VM_FAULT_SIGBUS;
-    }
+    
+    // Get the page for this offset, allocating it on first touch
+    page = example_buf_page(buf, vmf->pgoff, true, vma, vmf->address);
+    if (!page)
+        return VM_FAULT_OOM;
+    
+    // A write to a private mapping needs a COW copy of just this page,
+    // which only the single page path below gets from the core
+    if (map_mode == MAP_MODE_AROUND &&
+        !((vmf->flags & FAULT_FLAG_WRITE) && !(vma->vm_flags & VM_SHARED)))
+        return example_vma_fault_around(vmf);
+    
+    atomic_long_inc(&vma_dev->pages_mapped);
+    
+    // PFN mappings have no struct page references to hand back
+    if (vma->vm_flags & VM_PFNMAP)
+        return vmf_insert_pfn(vma, vmf->address, page_to_pfn(page));
     
     // Set up the page
     get_page(page);
     vmf->page = page;
+    return 0;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+// Map a whole PMD when the 2 MB around the address lies inside both the
+// VMA and one contiguous chunk of the buffer; anything else falls back
+// to the 4K ->fault path
+static vm_fault_t example_vma_huge_fault(struct vm_fault *vmf, enum page_entry_size pe_size)
+{
+    struct vm_area_struct *vma = vmf->vma;
+    struct simple_vma_buf *buf = vma->vm_private_data;
+    unsigned long haddr = vmf->address & PMD_MASK;
+    pgoff_t pgoff;
     
-    pr_info("simple_vma: Page fault handled successfully\n");
+    if (pe_size != PE_SIZE_PMD || !(vma->vm_flags & VM_PFNMAP))
+        return VM_FAULT_FALLBACK;
+    if (haddr < vma->vm_start || haddr + PMD_SIZE > vma->vm_end)
+        return VM_FAULT_FALLBACK;
+    
+    pgoff = linear_page_index(vma, haddr);
+    if (!IS_ALIGNED(pgoff, 1UL << CHUNK_ORDER) ||
+        pgoff + (1UL << CHUNK_ORDER) > buf->nr_pages)
+        return VM_FAULT_FALLBACK;
+    
+    atomic_long_inc(&vma_dev->huge_faults);
+    atomic_long_add(1UL << CHUNK_ORDER, &vma_dev->pages_mapped);
+    return vmf_insert_pfn_pmd(vmf, pfn_to_pfn_t(page_to_pfn(buf->pages[pgoff])),
+                              vmf->flags & FAULT_FLAG_WRITE);
+}
+#endif
+
+// First store to a write-protected page of a tracked mapping.  The core
+// makes the PTE writable after we return, unless the harvest ioctl
+// zapped it in the meantime, in which case the access faults again.
+static vm_fault_t example_vma_pfn_mkwrite(struct vm_fault *vmf)
+{
+    struct simple_vma_buf *buf = vmf->vma->vm_private_data;
+    
+    atomic_long_inc(&vma_dev->mkwrite_faults);
+    set_bit(vmf->pgoff, buf->dirty);
     return 0;
 }
 
@@ -75,101 +632,302 @@ static const struct vm_operations_struct example_vm_ops = {
     .open = example_vma_open,
     .close = example_vma_close,
     .fault = example_vma_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    .huge_fault = example_vma_huge_fault,
+#endif
+};
+
+// Shared mappings with dirty tracking: special PTEs, mapped read-only
+// until pfn_mkwrite has recorded the page, and never PMD-mapped
+static const struct vm_operations_struct example_dirty_vm_ops = {
+    .open = example_vma_open,
+    .close = example_vma_close,
+    .fault = example_vma_fault,
+    .pfn_mkwrite = example_vma_pfn_mkwrite,
 };
 
 // Device file operations
 static int example_char_open(struct inode *inode, struct file *file)
 {
-    pr_info("simple_vma: Device opened\n");
+    struct simple_vma_buf *buf = &vma_dev->buf;
+    
+    // A private buffer is the size of the shared one but starts empty;
+    // its pages come in on first fault or write
+    if (per_open_buffers) {
+        buf = kzalloc(sizeof(*buf), GFP_KERNEL);
+        if (!buf)
+            return -ENOMEM;
+        buf->size = vma_dev->buf.size;
+        buf->nr_pages = vma_dev->buf.nr_pages;
+        buf->backing = BACKING_VMALLOC;
+        buf->lazy = true;
+        buf->pages = kvcalloc(buf->nr_pages, sizeof(*buf->pages), GFP_KERNEL);
+        if (!buf->pages || example_alloc_meta(buf)) {
+            kvfree(buf->pages);
+            kfree(buf);
+            return -ENOMEM;
+        }
+    }
+    
+    file->private_data = buf;
+    file->f_mapping = buf->inode->i_mapping;
+    pr_debug("simple_vma: Device opened\n");
     return 0;
 }
 
+// Mappings hold a reference on the file, so by the time release runs
+// no VMA can still point at a private buffer
 static int example_char_release(struct inode *inode, struct file *file)
 {
-    pr_info("simple_vma: Device released\n");
+    struct simple_vma_buf *buf = file->private_data;
+    
+    if (buf != &vma_dev->buf) {
+        atomic_long_sub(example_free_buffer(buf), &vma_dev->private_pages);
+        kfree(buf);
+    }
+    
+    pr_debug("simple_vma: Device released\n");
     return 0;
 }
 
 static ssize_t example_char_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
 {
-    ssize_t ret = 0;
-    
-    if (mutex_lock_interruptible(&vma_dev->mutex))
-        return -ERESTARTSYS;
-    
-    if (*ppos >= BUFFER_SIZE)
-        goto out;
+    struct simple_vma_buf *vbuf = file->private_data;
+    ssize_t ret;
     
-    if (*ppos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *ppos;
+    if (*ppos >= vbuf->size)
+        return 0;
     
-    if (copy_to_user(buf, vma_dev->buffer + *ppos, count)) {
-        ret = -EFAULT;
-        goto out;
-    }
+    if (*ppos + count > vbuf->size)
+        count = vbuf->size - *ppos;
     
-    *ppos += count;
-    ret = count;
+    ret = example_buf_rw(vbuf, buf, count, *ppos, false);
+    if (ret > 0)
+        *ppos += ret;
     
-out:
-    mutex_unlock(&vma_dev->mutex);
     return ret;
 }
 
 static ssize_t example_char_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
 {
-    ssize_t ret = 0;
-    
-    if (mutex_lock_interruptible(&vma_dev->mutex))
-        return -ERESTARTSYS;
+    struct simple_vma_buf *vbuf = file->private_data;
+    ssize_t ret;
     
-    if (*ppos >= BUFFER_SIZE) {
-        ret = -ENOSPC;
-        goto out;
-    }
+    if (*ppos >= vbuf->size)
+        return -ENOSPC;
     
-    if (*ppos + count > BUFFER_SIZE)
-        count = BUFFER_SIZE - *ppos;
+    if (*ppos + count > vbuf->size)
+        count = vbuf->size - *ppos;
     
-    if (copy_from_user(vma_dev->buffer + *ppos, buf, count)) {
-        ret = -EFAULT;
-        goto out;
-    }
+    ret = example_buf_rw(vbuf, (char __user *)buf, count, *ppos, true);
+    if (ret > 0)
+        *ppos += ret;
     
-    *ppos += count;
-    ret = count;
-    
-out:
-    mutex_unlock(&vma_dev->mutex);
     return ret;
 }
 
 // Memory mapping implementation
 static int example_char_mmap(struct file *file, struct vm_area_struct *vma)
 {
+    struct simple_vma_buf *buf = file->private_data;
     unsigned long size = vma->vm_end - vma->vm_start;
+    long mapped;
     
-    pr_info("simple_vma: mmap called - start: 0x%lx, end: 0x%lx, size: %lu\n",
+    pr_debug("simple_vma: mmap called - start: 0x%lx, end: 0x%lx, size: %lu\n",
             vma->vm_start, vma->vm_end, size);
     
-    // Check size
-    if (size > BUFFER_SIZE) {
-        pr_err("simple_vma: Requested size too large: %lu > %d\n", size, BUFFER_SIZE);
+    // The window [vm_pgoff, vm_pgoff + pages) must lie inside the buffer;
+    // VM_DONTEXPAND keeps it there afterwards
+    if (vma->vm_pgoff >= buf->nr_pages || vma_pages(vma) > buf->nr_pages - vma->vm_pgoff) {
+        pr_debug("simple_vma: Window %lu+%lu pages outside %lu page buffer\n",
+                 vma->vm_pgoff, vma_pages(vma), buf->nr_pages);
         return -EINVAL;
     }
     
-    // Set VMA flags
+    // Set VMA flags.  Contiguous backing is mapped by PFN, which is what
+    // lets huge_fault install whole PMDs; PFN maps cannot be COWed, so
+    // private mappings stay on struct page insertion.  Either way the
+    // fault handler can insert pages while holding mmap_lock for read.
     vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
-    vma->vm_private_data = vma_dev;
+    vma->vm_private_data = buf;
     vma->vm_ops = &example_vm_ops;
+    if (buf->dirty && (vma->vm_flags & VM_SHARED)) {
+        // pfn_mkwrite needs special PTEs: ->page_mkwrite on a struct page
+        // would want the page in a page cache.  Write-protect from the
+        // start, as vma_set_page_prot() would only after eager mapping.
+        vma->vm_flags |= VM_PFNMAP;
+        vma->vm_ops = &example_dirty_vm_ops;
+        vma->vm_page_prot = vm_get_page_prot(vma->vm_flags & ~VM_SHARED);
+    } else if (IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE) && buf->backing != BACKING_VMALLOC &&
+               (vma->vm_flags & VM_SHARED)) {
+        vma->vm_flags |= VM_PFNMAP | VM_HUGEPAGE;
+    } else {
+        vma->vm_flags |= VM_MIXEDMAP;
+    }
+    
+    // Populate every PTE now instead of taking a fault per page.  PMD
+    // mappings are left to huge_fault, which is one fault per 2 MB anyway.
+    if (map_mode == MAP_MODE_EAGER && !(vma->vm_flags & VM_HUGEPAGE)) {
+        mapped = example_map_range(vma, vma->vm_start, vma->vm_end);
+        if (mapped < 0)
+            return mapped;
+        atomic_long_add(mapped, &vma_dev->pages_mapped);
+    }
     
     // Call open to initialize
     example_vma_open(vma);
     
-    pr_info("simple_vma: mmap completed successfully\n");
+    pr_debug("simple_vma: mmap completed successfully\n");
     return 0;
 }
 
+// Report and clear the dirty bits of a range, then zap the PTEs of every
+// page reported so the next store to it goes through pfn_mkwrite again.
+// All mappings of buf, and only those, share its inode's address_space.
+static long example_get_dirty(struct simple_vma_buf *buf, struct simple_vma_dirty __user *uarg)
+{
+    struct simple_vma_dirty req;
+    unsigned long *bits, i, end;
+    u32 *words;
+    long ret = 0;
+    
+    if (!buf->dirty)
+        return -EOPNOTSUPP;
+    if (copy_from_user(&req, uarg, sizeof(req)))
+        return -EFAULT;
+    if (!req.nr_pages || req.start >= buf->nr_pages || req.nr_pages > buf->nr_pages - req.start)
+        return -EINVAL;
+    
+    bits = kvcalloc(BITS_TO_LONGS(req.nr_pages), sizeof(long), GFP_KERNEL);
+    words = kvcalloc(DIV_ROUND_UP(req.nr_pages, 32), sizeof(u32), GFP_KERNEL);
+    if (!bits || !words) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    
+    mutex_lock(&buf->dirty_lock);
+    req.nr_dirty = 0;
+    for (i = 0; i < req.nr_pages; i++) {
+        if (test_and_clear_bit(req.start + i, buf->dirty)) {
+            __set_bit(i, bits);
+            req.nr_dirty++;
+        }
+    }
+    for (i = find_first_bit(bits, req.nr_pages); i < req.nr_pages;
+         i = find_next_bit(bits, req.nr_pages, end)) {
+        end = find_next_zero_bit(bits, req.nr_pages, i);
+        unmap_mapping_range(buf->inode->i_mapping, (loff_t)(req.start + i) << PAGE_SHIFT,
+                            (loff_t)(end - i) << PAGE_SHIFT, 0);
+    }
+    mutex_unlock(&buf->dirty_lock);
+    
+    bitmap_to_arr32(words, bits, req.nr_pages);
+    if (copy_to_user(u64_to_user_ptr(req.bitmap), words,
+                     DIV_ROUND_UP(req.nr_pages, 32) * sizeof(u32)) ||
+        copy_to_user(uarg, &req, sizeof(req)))
+        ret = -EFAULT;
+    
+out:
+    kvfree(words);
+    kvfree(bits);
+    return ret;
+}
+
+static long example_char_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    switch (cmd) {
+    case SIMPLE_VMA_GET_DIRTY:
+        return example_get_dirty(file->private_data, (void __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+// Shared mappings of contiguous backing get a PMD-aligned address so
+// huge_fault can use them
+static unsigned long example_char_get_unmapped_area(struct file *file, unsigned long addr,
+                                                    unsigned long len, unsigned long pgoff,
+                                                    unsigned long flags)
+{
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+    struct simple_vma_buf *buf = file->private_data;
+    
+    if (buf->backing != BACKING_VMALLOC && (flags & MAP_SHARED))
+        return thp_get_unmapped_area(file, addr, len, pgoff, flags);
+#endif
+    return current->mm->get_unmapped_area(file, addr, len, pgoff, flags);
+}
+
+// sysfs: /sys/class/simple_vma/simple_vma/{size,faults,huge_faults,pages_mapped,
+//        private_pages,mkwrite_faults,read_retries,node_pages}
+static ssize_t size_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%zu\n", vma_dev->buf.size);
+}
+static DEVICE_ATTR_RO(size);
+
+static ssize_t faults_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%ld\n", atomic_long_read(&vma_dev->faults));
+}
+static DEVICE_ATTR_RO(faults);
+
+static ssize_t huge_faults_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%ld\n", atomic_long_read(&vma_dev->huge_faults));
+}
+static DEVICE_ATTR_RO(huge_faults);
+
+static ssize_t pages_mapped_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%ld\n", atomic_long_read(&vma_dev->pages_mapped));
+}
+static DEVICE_ATTR_RO(pages_mapped);
+
+static ssize_t private_pages_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%ld\n", atomic_long_read(&vma_dev->private_pages));
+}
+static DEVICE_ATTR_RO(private_pages);
+
+static ssize_t mkwrite_faults_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%ld\n", atomic_long_read(&vma_dev->mkwrite_faults));
+}
+static DEVICE_ATTR_RO(mkwrite_faults);
+
+static ssize_t read_retries_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    return sysfs_emit(buf, "%ld\n", atomic_long_read(&vma_dev->read_retries));
+}
+static DEVICE_ATTR_RO(read_retries);
+
+// One line in numa_maps style: "N0=<pages> N1=<pages> ..."
+static ssize_t node_pages_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+    int nid, len = 0;
+    
+    for_each_online_node(nid)
+        len += sysfs_emit_at(buf, len, "%sN%d=%ld", len ? " " : "", nid,
+                             atomic_long_read(&vma_dev->node_pages[nid]));
+    len += sysfs_emit_at(buf, len, "\n");
+    return len;
+}
+static DEVICE_ATTR_RO(node_pages);
+
+static struct attribute *simple_vma_attrs[] = {
+    &dev_attr_size.attr,
+    &dev_attr_faults.attr,
+    &dev_attr_huge_faults.attr,
+    &dev_attr_pages_mapped.attr,
+    &dev_attr_private_pages.attr,
+    &dev_attr_mkwrite_faults.attr,
+    &dev_attr_read_retries.attr,
+    &dev_attr_node_pages.attr,
+    NULL,
+};
+ATTRIBUTE_GROUPS(simple_vma);
+
 static const struct file_operations example_fops = {
     .owner = THIS_MODULE,
     .open = example_char_open,
@@ -177,10 +935,27 @@ static const struct file_operations example_fops = {
     .read = example_char_read,
     .write = example_char_write,
     .mmap = example_char_mmap,
+    .unlocked_ioctl = example_char_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .get_unmapped_area = example_char_get_unmapped_area,
+};
+
+// Pseudo fs holding one inode per buffer, see example_alloc_meta()
+static int simple_vma_init_fs_context(struct fs_context *fc)
+{
+    return init_pseudo(fc, SIMPLE_VMA_FS_MAGIC) ? 0 : -ENOMEM;
+}
+
+static struct file_system_type simple_vma_fs_type = {
+    .name = "simple_vma",
+    .owner = THIS_MODULE,
+    .init_fs_context = simple_vma_init_fs_context,
+    .kill_sb = kill_anon_super,
 };
 
 static int __init simple_vma_init(void)
 {
+    struct simple_vma_buf *buf;
     int ret;
     
     pr_info("simple_vma: Initializing VMA example module\n");
@@ -190,18 +965,57 @@ static int __init simple_vma_init(void)
     if (!vma_dev)
         return -ENOMEM;
     
-    mutex_init(&vma_dev->mutex);
+    buf = &vma_dev->buf;
     
-    // Allocate buffer using vmalloc for demonstration
-    vma_dev->buffer = vmalloc(BUFFER_SIZE);
-    if (!vma_dev->buffer) {
+    vma_dev->node_pages = kcalloc(nr_node_ids, sizeof(*vma_dev->node_pages), GFP_KERNEL);
+    if (!vma_dev->node_pages) {
         ret = -ENOMEM;
         goto err_free_dev;
     }
     
-    // Initialize buffer with pattern
-    memset(vma_dev->buffer, 0x42, BUFFER_SIZE);
-    sprintf(vma_dev->buffer, "Hello from kernel VMA example!\n");
+    ret = simple_pin_fs(&simple_vma_fs_type, &simple_vma_mnt, &simple_vma_mnt_count);
+    if (ret)
+        goto err_free_dev;
+    
+    // Contiguous backing comes in whole 2 MB chunks
+    buf->backing = backing;
+    if (backing == BACKING_VMALLOC)
+        buf->size = PAGE_ALIGN(buffer_size);
+    else
+        buf->size = ALIGN(buffer_size, PMD_SIZE);
+    buf->nr_pages = buf->size >> PAGE_SHIFT;
+    if (!buf->nr_pages) {
+        ret = -EINVAL;
+        goto err_release_fs;
+    }
+    
+    // NUMA placement needs the pages allocated one by one on first touch,
+    // which only the 4K backing does
+    if (numa_policy != NUMA_AT_LOAD) {
+        if (backing != BACKING_VMALLOC) {
+            pr_err("simple_vma: numa_policy needs backing=0\n");
+            ret = -EINVAL;
+            goto err_release_fs;
+        }
+        buf->lazy = true;
+        buf->pages = kvcalloc(buf->nr_pages, sizeof(*buf->pages), GFP_KERNEL);
+        ret = buf->pages ? 0 : -ENOMEM;
+    } else {
+        ret = example_alloc_buffer(buf);
+    }
+    if (ret) {
+        pr_err("simple_vma: Failed to allocate %zu byte buffer\n", buf->size);
+        goto err_release_fs;
+    }
+    example_account_pages(buf, 1);
+    
+    ret = example_alloc_meta(buf);
+    if (ret)
+        goto err_free_buffer;
+    
+    // A lazy buffer starts out zeroed, wherever its pages end up
+    if (!buf->lazy)
+        example_fill_buffer(buf);
     
     // Get device number
     ret = alloc_chrdev_region(&dev_number, 0, 1, DEVICE_NAME);
@@ -231,7 +1045,8 @@ static int __init simple_vma_init(void)
     }
     
     // Create device node
-    vma_dev->device = device_create(vma_dev->class, NULL, dev_number, NULL, DEVICE_NAME);
+    vma_dev->device = device_create_with_groups(vma_dev->class, NULL, dev_number, NULL,
+                                                simple_vma_groups, DEVICE_NAME);
     if (IS_ERR(vma_dev->device)) {
         ret = PTR_ERR(vma_dev->device);
         pr_err("simple_vma: Failed to create device\n");
@@ -240,7 +1055,7 @@ static int __init simple_vma_init(void)
     
     pr_info("simple_vma: Module loaded successfully\n");
     pr_info("simple_vma: Device created at /dev/%s (major: %d)\n", DEVICE_NAME, major_number);
-    pr_info("simple_vma: Buffer size: %d bytes (%d pages)\n", BUFFER_SIZE, BUFFER_SIZE / PAGE_SIZE);
+    pr_info("simple_vma: Buffer size: %zu bytes (%lu pages)\n", buf->size, buf->nr_pages);
     
     return 0;
     
@@ -251,8 +1066,11 @@ err_del_cdev:
 err_unreg_chrdev:
     unregister_chrdev_region(dev_number, 1);
 err_free_buffer:
-    vfree(vma_dev->buffer);
+    example_free_buffer(buf);
+err_release_fs:
+    simple_release_fs(&simple_vma_mnt, &simple_vma_mnt_count);
 err_free_dev:
+    kfree(vma_dev->node_pages);
     kfree(vma_dev);
     return ret;
 }
@@ -264,7 +1082,9 @@ static void __exit simple_vma_exit(void)
         class_destroy(vma_dev->class);
         cdev_del(&vma_dev->cdev);
         unregister_chrdev_region(dev_number, 1);
-        vfree(vma_dev->buffer);
+        example_free_buffer(&vma_dev->buf);
+        simple_release_fs(&simple_vma_mnt, &simple_vma_mnt_count);
+        kfree(vma_dev->node_pages);
         kfree(vma_dev);
     }
     